@@ -6,13 +6,23 @@
  */
 
 #include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
 #include "spak_public.h"
 
+/*
+ * one cell of the knapsack table: the energy saved, and which of the
+ * tasks considered so far (bit i = i-th row) are slowed down to save it
+ */
 typedef struct {
     energy_value v;
-    struct task_set* ts;
+    unsigned long long slowed;
 } tab_item_t;
 
+#define MAX_TAB_ITEMS ((int)(8*sizeof(unsigned long long)))
+
 #define TOTAL_TASKS_NUMBER   (10)
 #define SIMULATE_TIME        (50000)
 
@@ -47,7 +57,10 @@ static inline void ffree (void* p)
 static struct task_set* create_radom_task_set_by_utilization(const double u)
 {
     struct task_set* ts = NULL;
-    spak_srand();
+    // the sweep hands each set its own stream
+    if(NULL==spak_rng_current()) {
+        spak_srand();
+    }
     do {
         if(NULL!=ts) {
             free_task_set(ts);
@@ -93,52 +106,259 @@ static struct task_set* create_special_task_set(void)
                           "special task set",
                           10000, 0, 0, 0,
                           "ee_fppt");
-    new_dvs_task (ts,tc[0].cu,tc[0].t,tc[0].t,1,tc[0].t,0,0,MAX_FREQ_LEVEL,"t0");
-    new_dvs_task (ts,tc[1].cu,tc[1].t,tc[1].t,1,tc[1].t,0,0,MAX_FREQ_LEVEL,"t1");
-    new_dvs_task (ts,tc[2].cu,tc[2].t,tc[2].t,1,tc[2].t,0,0,MAX_FREQ_LEVEL,"t2");
-    new_dvs_task (ts,tc[3].cu,tc[3].t,tc[3].t,1,tc[3].t,0,0,MAX_FREQ_LEVEL,"t3");
-    new_dvs_task (ts,tc[4].cu,tc[4].t,tc[4].t,1,tc[4].t,0,0,MAX_FREQ_LEVEL,"t4");
-    new_dvs_task (ts,tc[5].cu,tc[5].t,tc[5].t,1,tc[5].t,0,0,MAX_FREQ_LEVEL,"t5");
-    new_dvs_task (ts,tc[6].cu,tc[6].t,tc[6].t,1,tc[6].t,0,0,MAX_FREQ_LEVEL,"t6");
-    new_dvs_task (ts,tc[7].cu,tc[7].t,tc[7].t,1,tc[7].t,0,0,MAX_FREQ_LEVEL,"t7");
-    new_dvs_task (ts,tc[8].cu,tc[8].t,tc[8].t,1,tc[8].t,0,0,MAX_FREQ_LEVEL,"t8");
-    new_dvs_task (ts,tc[9].cu,tc[9].t,tc[9].t,1,tc[9].t,0,0,MAX_FREQ_LEVEL,"t9");
+    new_dvs_task (ts,tc[0].cu,tc[0].t,tc[0].t,1,tc[0].t,0,0,get_max_frequency_level(ts),"t0");
+    new_dvs_task (ts,tc[1].cu,tc[1].t,tc[1].t,1,tc[1].t,0,0,get_max_frequency_level(ts),"t1");
+    new_dvs_task (ts,tc[2].cu,tc[2].t,tc[2].t,1,tc[2].t,0,0,get_max_frequency_level(ts),"t2");
+    new_dvs_task (ts,tc[3].cu,tc[3].t,tc[3].t,1,tc[3].t,0,0,get_max_frequency_level(ts),"t3");
+    new_dvs_task (ts,tc[4].cu,tc[4].t,tc[4].t,1,tc[4].t,0,0,get_max_frequency_level(ts),"t4");
+    new_dvs_task (ts,tc[5].cu,tc[5].t,tc[5].t,1,tc[5].t,0,0,get_max_frequency_level(ts),"t5");
+    new_dvs_task (ts,tc[6].cu,tc[6].t,tc[6].t,1,tc[6].t,0,0,get_max_frequency_level(ts),"t6");
+    new_dvs_task (ts,tc[7].cu,tc[7].t,tc[7].t,1,tc[7].t,0,0,get_max_frequency_level(ts),"t7");
+    new_dvs_task (ts,tc[8].cu,tc[8].t,tc[8].t,1,tc[8].t,0,0,get_max_frequency_level(ts),"t8");
+    new_dvs_task (ts,tc[9].cu,tc[9].t,tc[9].t,1,tc[9].t,0,0,get_max_frequency_level(ts),"t9");
     set_priorities (ts, INORDER);
     feasible(ts, TRUE);
     return ts;
 }
 
+/*
+ * Feasibility cache.  The searches below keep asking the same questions
+ * about one random task set with different frequency levels, so the
+ * outcome of threshold assignment is remembered per (frequency level,
+ * priority) vector, and plain feasibility per (frequency level,
+ * priority, preemption threshold) vector.  The table is direct-mapped
+ * with FCACHE_SIZE entries; a colliding key evicts the old entry.  It
+ * must be reset whenever a new task set is generated.
+ */
+#define FCACHE_SIZE          (4096)
+#define FCACHE_MAX_TASKS     (32)
+
+enum fcache_kind {
+    FCACHE_THRESH = 1,
+    FCACHE_FEASIBLE
+};
+
+struct fcache_entry {
+    enum fcache_kind kind;
+    int key[3*FCACHE_MAX_TASKS];
+    int feasible;
+    int pt_ipta[FCACHE_MAX_TASKS];   // thresholds after assignment
+    int pt_mpta[FCACHE_MAX_TASKS];   // ... and after maximization
+    int mpta_valid;
+};
+
+static struct fcache_entry* fcache = NULL;
+static long fcache_hits = 0;
+static long fcache_misses = 0;
+static long fcache_evictions = 0;
+
+static void fcache_reset(void)
+{
+    if(NULL==fcache) {
+        fcache = (struct fcache_entry*)fmalloc(FCACHE_SIZE*sizeof(struct fcache_entry));
+    }
+    memset(fcache,0,FCACHE_SIZE*sizeof(struct fcache_entry));
+}
+
+static int fcache_make_key(struct task_set* ts, enum fcache_kind kind, int* key)
+{
+    int n = num_tasks(ts);
+    int len = 0;
+    int i = 0;
+
+    assert(n <= FCACHE_MAX_TASKS);
+
+    for(i=0; i<n; i++) {
+        key[len++] = get_task_frequency_level(ts,i);
+        key[len++] = get_pri(ts,i);
+        if(FCACHE_FEASIBLE==kind) {
+            key[len++] = get_preempt_thresh(ts,i);
+        }
+    }
+    return len;
+}
+
+/*
+ * returns the entry for ts: a valid one on a hit, otherwise a slot
+ * that has been claimed for ts and still needs filling in
+ */
+static struct fcache_entry* fcache_lookup(struct task_set* ts, enum fcache_kind kind, int* hit)
+{
+    int key[3*FCACHE_MAX_TASKS];
+    int len = fcache_make_key(ts, kind, key);
+    unsigned long long h = 14695981039346656037ULL;    // FNV-1a
+    struct fcache_entry* e = NULL;
+    int i = 0;
+
+    assert(fcache);
+
+    h = (h^kind)*1099511628211ULL;
+    for(i=0; i<len; i++) {
+        h = (h^(unsigned int)key[i])*1099511628211ULL;
+    }
+    e = &fcache[h%FCACHE_SIZE];
+
+    if((e->kind==kind) && !memcmp(e->key,key,len*sizeof(int))) {
+        fcache_hits++;
+        *hit = TRUE;
+        return e;
+    }
+
+    fcache_misses++;
+    if(e->kind) {
+        fcache_evictions++;
+    }
+    memset(e,0,sizeof(struct fcache_entry));
+    e->kind = kind;
+    memcpy(e->key,key,len*sizeof(int));
+    *hit = FALSE;
+    return e;
+}
+
+static void fcache_save_pt(struct task_set* ts, int* pt)
+{
+    int i = 0;
+    for(i=num_tasks(ts)-1; i>=0; i--) {
+        pt[i] = get_preempt_thresh(ts,i);
+    }
+}
+
+static void fcache_restore_pt(struct task_set* ts, const int* pt)
+{
+    int i = 0;
+    for(i=num_tasks(ts)-1; i>=0; i--) {
+        set_preempt_thresh(ts,i,pt[i]);
+    }
+}
+
+static void fcache_print_stats(FILE* fp)
+{
+    long lookups = fcache_hits + fcache_misses;
+
+    fprintf(fp,"feasibility cache: %ld lookups, %ld hits (%.1f%%), %ld evictions\n",
+            lookups, fcache_hits,
+            (lookups)? 100.0*fcache_hits/lookups: 0.0,
+            fcache_evictions);
+}
+
+/*
+ * threshold assignment (IPTA), through the cache
+ */
+static struct fcache_entry* fcache_assign_thresholds(struct task_set* ts)
+{
+    int hit = FALSE;
+    struct fcache_entry* e = fcache_lookup(ts, FCACHE_THRESH, &hit);
+
+    if(hit) {
+        fcache_restore_pt(ts, e->pt_ipta);
+    }
+    else {
+        e->feasible = assign_optimal_preemption_thresholds(ts);
+        fcache_save_pt(ts, e->pt_ipta);
+    }
+    return e;
+}
+
 static int set_taskset_MPTA(struct task_set* ts)
 {
-    if(!assign_optimal_preemption_thresholds(ts)) {
+    struct fcache_entry* e = fcache_assign_thresholds(ts);
+
+    if(!e->feasible) {
         return FALSE;
     }
-    maximize_preempt_thresholds(ts);
+    if(e->mpta_valid) {
+        fcache_restore_pt(ts, e->pt_mpta);
+    }
+    else {
+        maximize_preempt_thresholds(ts);
+        fcache_save_pt(ts, e->pt_mpta);
+        e->mpta_valid = TRUE;
+    }
     return TRUE;
 }
 
 static int set_taskset_IPTA(struct task_set* ts)
 {
-    if(!assign_optimal_preemption_thresholds(ts)) {
-        return FALSE;
+    return fcache_assign_thresholds(ts)->feasible;
+}
+
+/*
+ * feasible(ts, TRUE)==num_tasks(ts), through the cache; on a hit the
+ * tasks' response times are not updated
+ */
+static int is_taskset_feasible(struct task_set* ts)
+{
+    int hit = FALSE;
+    struct fcache_entry* e = fcache_lookup(ts, FCACHE_FEASIBLE, &hit);
+
+    if(!hit) {
+        e->feasible = (feasible(ts, TRUE)==num_tasks(ts));
     }
-    return TRUE;
+    return e->feasible;
+}
+
+
+/*
+ * with static power, going below the profile's critical level only
+ * costs energy, so the searches stop there
+ */
+static inline freq_level lowest_useful_level(struct task_set* ts)
+{
+    return dvfs_critical_level(get_dvfs_profile(ts));
+}
+
+/*
+ * Lowest level in [lo,hi] at which ok(ts,t,level) holds, given that it
+ * holds at hi.  Running slower never makes a task set easier to
+ * schedule, so the levels where ok holds are a range ending at hi and
+ * the ladder can be bisected.
+ */
+typedef int (*level_test_t)(struct task_set* ts, int t, freq_level f);
+
+static freq_level lowest_feasible_level(struct task_set* ts, int t,
+                                        freq_level lo, freq_level hi, level_test_t ok)
+{
+    while(lo < hi) {
+        freq_level mid = lo + (hi-lo)/2;
+        if(ok(ts, t, mid)) {
+            hi = mid;
+        }
+        else {
+            lo = mid+1;
+        }
+    }
+    return hi;
 }
 
+// task t at level f, everything else (thresholds included) as it is
+static int feasible_with_task_at(struct task_set* ts, int t, freq_level f)
+{
+    return ee_fppt_feasible_at(ts, t, f);
+}
+
+// every task at level f, with thresholds reassigned; ts is scratch
+static int feasible_with_all_at(struct task_set* ts, int t, freq_level f)
+{
+    int i = 0;
+
+    for(i=0; i<num_tasks(ts); i++) {
+        set_task_frequency_level(ts, i, f);
+    }
+    return set_taskset_MPTA(ts);
+}
 
 static void set_lowest_freq_level_for_all_tasks(struct task_set* ts)
 {
     struct task_set* ts_copy = copy_task_set(ts);
-    freq_level old_f_level = MAX_FREQ_LEVEL;
+    freq_level top = get_task_set_frequency_level(ts);
+    freq_level f = top;
 
-    while(MIN_FREQ_LEVEL < (old_f_level=get_task_set_frequency_level(ts_copy))) {
-        dec_task_set_frequency_level(ts_copy);
-        if(!set_taskset_MPTA(ts_copy)) {
-            break;
-        }
+    if(lowest_useful_level(ts) < top) {
+        f = lowest_feasible_level(ts_copy, -1, lowest_useful_level(ts), top,
+                                  feasible_with_all_at);
     }
     free_task_set(ts_copy);
-    set_task_set_frequency_level(ts, old_f_level);
+    set_task_set_frequency_level(ts, f);
     set_taskset_MPTA(ts);
 }
 
@@ -162,30 +382,22 @@ static time_value sum_cu_in_same_freq_level(struct task_set* ts, const freq_leve
     return cu_sum;
 }
 
-static int try_feasible_with_MPTA(struct task_set* ts)
-{
-    int ret = FALSE;
-    struct task_set* ts_copy = copy_task_set(ts);
-
-    if(set_taskset_MPTA(ts_copy)) {
-        ret = TRUE;
-    }
-    free_task_set(ts_copy);
-
-    return ret;
-}
-
 static int try_feasible_after_task_slowdown(struct task_set* ts, const int t)
 {
     int ret = FALSE;
-    struct task_set* ts_copy = copy_task_set(ts);
-    freq_level f = get_task_frequency_level(ts_copy, t);
+    struct task_set* ts_copy = NULL;
+    freq_level f = get_task_frequency_level(ts, t);
     assert (f>MIN_FREQ_LEVEL);
 
+    // the current thresholds often still work, and asking costs no copy
+    if(ee_fppt_feasible_at(ts, t, f-1)) {
+        return TRUE;
+    }
+
+    ts_copy = copy_task_set(ts);
     set_task_frequency_level(ts_copy, t, f-1);
-    if(try_feasible_with_MPTA(ts_copy)) {
+    if(set_taskset_IPTA(ts_copy)) {
         ret = TRUE;
-
     }
     free_task_set(ts_copy);
 
@@ -195,9 +407,9 @@ static int try_feasible_after_task_slowdown(struct task_set* ts, const int t)
 static inline time_value get_task_C_at_set_f(struct task_set* ts, const int t, const freq_level f)
 {
     assert (f >= MIN_FREQ_LEVEL);
-    assert (f <= MAX_FREQ_LEVEL);
+    assert (f <= get_max_frequency_level(ts));
 
-    return modify_task_C_by_freq(get_Cu(ts,t),valid_f_scale[f]);
+    return get_task_wcet_at_level(ts,t,f);
 }
 
 static time_value get_C_after_task_slowdown(struct task_set* ts, const int t)
@@ -210,12 +422,7 @@ static time_value get_C_after_task_slowdown(struct task_set* ts, const int t)
 
 static inline energy_value get_task_energy_at_set_f(struct task_set* ts, const int t, const freq_level f)
 {
-    assert (f >= MIN_FREQ_LEVEL);
-    assert (f <= MAX_FREQ_LEVEL);
-
-    int exe_times = (int)(SIMULATE_TIME/get_period(ts,t));
-
-    return 1.0*exe_times*get_task_C_at_set_f(ts,t,f)*pow(valid_f_scale[f], 3.0);
+    return compute_task_energy(ts,t,f,SIMULATE_TIME,NULL);
 }
 
 static inline energy_value calculate_saved_energy_after_task_slowdown(struct task_set* ts, const int t)
@@ -226,58 +433,22 @@ static inline energy_value calculate_saved_energy_after_task_slowdown(struct tas
     return (get_task_energy_at_set_f(ts,t,f) - get_task_energy_at_set_f(ts,t,f-1));
 }
 
-static int is_accept_tab_item(tab_item_t* tab, tab_item_t* old_tab, const int t)
-{
-    if(try_feasible_after_task_slowdown(old_tab->ts, t)) {
-        energy_value task_saved_energy = calculate_saved_energy_after_task_slowdown(old_tab->ts,t);
-        if(tab->v < (old_tab->v+task_saved_energy)) {
-            return TRUE;
-        }
-    }
-    return FALSE;
-}
-
-static void do_accept_tab_item(tab_item_t* tab, tab_item_t* old_tab, const int t)
-{
-    tab->v = old_tab->v + calculate_saved_energy_after_task_slowdown(old_tab->ts,t);
-    free_task_set(tab->ts);
-    tab->ts = copy_task_set(old_tab->ts);
-    dec_task_frequency_level(tab->ts, t);
-    set_taskset_MPTA(tab->ts);
-}
-
-static struct task_set* find_max_low_energy_task_set_from_tab(void* p, int r, int c)
+/*
+ * is the base task set still feasible (under MPTA) with the given
+ * row tasks slowed down from level f?  ts_scratch is reused between
+ * calls to avoid copying the task set
+ */
+static int try_feasible_with_slowed_tasks(struct task_set* ts_scratch,
+        const int* items, const int item_num,
+        unsigned long long slowed, const freq_level f)
 {
-    tab_item_t (*tab)[c+1] = (tab_item_t (*)[c+1])p;
-    energy_value max_value = 0;
-    int max_r = 0;
-    int max_c = 0;
-    int i,j;
+    int i = 0;
 
-    for(i=1; i<=r; i++) {
-        for(j=1; j<=c; j++) {
-            if(max_value < tab[i][j].v) {
-                max_value = tab[i][j].v;
-                max_r = i;
-                max_c = j;
-            }
-        }
+    for(i=0; i<item_num; i++) {
+        set_task_frequency_level(ts_scratch, items[i], (slowed&(1ULL<<i))? f-1: f);
     }
 
-    return tab[max_r][max_c].ts;
-}
-
-static void free_tab(void* p, int r, int c)
-{
-    tab_item_t (*tab)[c+1] = (tab_item_t (*)[c+1])p;
-    int i,j;
-
-    for (j=0; j<=r; j++) {
-        for(i=0; i<=c; i++) {
-            free_task_set(tab[j][i].ts);
-        }
-    }
-    ffree(tab);
+    return set_taskset_IPTA(ts_scratch);
 }
 
 static struct task_set* get_lowest_energy_taskset_on_sub_freq(struct task_set* ts, const freq_level f)
@@ -288,18 +459,18 @@ static struct task_set* get_lowest_energy_taskset_on_sub_freq(struct task_set* t
     int time = 0;
     int task = 0;
     int i = 0;
-    const int total_tasks_num = num_tasks(ts);
-    const time_value max_time = modify_task_C_by_freq(sum_cu_in_same_freq_level(ts, f), valid_f_scale[f-1]);
+    int items[MAX_TAB_ITEMS];
+    const time_value max_time = modify_task_C_by_freq(sum_cu_in_same_freq_level(ts, f), get_frequency_scale(ts,f-1));
+    tab_item_t* prev = (tab_item_t*)fmalloc((max_time+1)*sizeof(tab_item_t));
+    tab_item_t* cur = (tab_item_t*)fmalloc((max_time+1)*sizeof(tab_item_t));
+    tab_item_t best = {0, 0};
+    struct task_set* ts_scratch = copy_task_set(ts);
+    struct task_set* ts_lowest = NULL;
 
-    tab_item_t (*tab)[max_time+1] = (tab_item_t (*)[max_time+1])fmalloc(
-                                        (total_tasks_num+1)*(max_time+1)*sizeof(tab_item_t));
-    memset(tab,0,(total_tasks_num+1)*(max_time+1)*sizeof(tab_item_t));
-    for(i=0; i<=max_time; i++) {
-        tab[0][i].ts = copy_task_set(ts);
-    }
+    memset(prev,0,(max_time+1)*sizeof(tab_item_t));
 
 #ifdef PRINT_TABLE
-    fprintf(log_fp,"find max length of frequency=%f.\n",valid_f_scale[f-1]);
+    fprintf(log_fp,"find max length of frequency=%f.\n",get_frequency_scale(ts,f-1));
     fprintf(log_fp,"i\\t      ");
     for(i=0; i<=max_time; i++) {
         fprintf(log_fp,"%4d  ",i);
@@ -307,38 +478,64 @@ static struct task_set* get_lowest_energy_taskset_on_sub_freq(struct task_set* t
     fprintf(log_fp,"\n");
 #endif
 
-    for(p=num_tasks(ts)-1,item=0; p>=0; p--) {
+    for(p=num_tasks(ts)-1; p>=0; p--) {
         task = find_task_by_pri(ts, p);
         if((f==get_task_frequency_level(ts,task)) &&
            try_feasible_after_task_slowdown(ts,task)) {
-            item++;
             time_value d = get_C_after_task_slowdown(ts,task);
-            for(i=0; i<=max_time; i++) {
-                tab[item][i].v = tab[item-1][i].v;
-                tab[item][i].ts = copy_task_set(tab[item-1][i].ts);
-            }
+            energy_value saved = calculate_saved_energy_after_task_slowdown(ts,task);
+            unsigned long long bit = 1ULL<<item;
+            tab_item_t* tmp = NULL;
+
+            assert(item < MAX_TAB_ITEMS);
+            items[item] = task;
+
+            memcpy(cur,prev,(max_time+1)*sizeof(tab_item_t));
             for(time=d; time<=max_time; time++) {
-                if(is_accept_tab_item(&tab[item][time], &tab[item-1][time-d], task)) {
-                    do_accept_tab_item(&tab[item][time], &tab[item-1][time-d], task);
+                tab_item_t* old = &prev[time-d];
+                // the feasibility test is the expensive part; only do it for an improvement
+                if((cur[time].v < (old->v+saved)) &&
+                   try_feasible_with_slowed_tasks(ts_scratch, items, item+1, old->slowed|bit, f)) {
+                    cur[time].v = old->v + saved;
+                    cur[time].slowed = old->slowed | bit;
+                }
+            }
+            item++;
+
+            for(i=1; i<=max_time; i++) {
+                if(best.v < cur[i].v) {
+                    best = cur[i];
                 }
             }
 #ifdef PRINT_TABLE
             fprintf(log_fp,"%s(p=%d) ",get_task_name(ts,task),get_pri(ts,task));
             for(i=0; i<=max_time; i++) {
-                fprintf(log_fp,"%.3f ",tab[item][i].v);
+                fprintf(log_fp,"%.3f ",cur[i].v);
             }
             fprintf(log_fp,"\n");
 #endif
+            tmp = prev;
+            prev = cur;
+            cur = tmp;
         }
     }
 
-    struct task_set* ts_lowest = find_max_low_energy_task_set_from_tab(tab, item, max_time);
-    free_task_set(ts);
-    ts = copy_task_set(ts_lowest);
+    ffree(prev);
+    ffree(cur);
+    free_task_set(ts_scratch);
 
-    free_tab(tab, item, max_time);
+    ts_lowest = copy_task_set(ts);
+    if(best.slowed) {
+        for(i=0; i<item; i++) {
+            if(best.slowed&(1ULL<<i)) {
+                dec_task_frequency_level(ts_lowest, items[i]);
+            }
+        }
+        set_taskset_MPTA(ts_lowest);
+    }
+    free_task_set(ts);
 
-    return ts;
+    return ts_lowest;
 }
 
 static int get_tasks_num_by_freq(struct task_set* ts, freq_level f)
@@ -346,7 +543,7 @@ static int get_tasks_num_by_freq(struct task_set* ts, freq_level f)
     int count = 0;
     int i = 0;
 
-    if((f>=MIN_FREQ_LEVEL)&&(f<=MAX_FREQ_LEVEL)) {
+    if((f>=MIN_FREQ_LEVEL)&&(f<=get_max_frequency_level(ts))) {
         for(i=num_tasks(ts)-1; i>=0; i--) {
             count += (f==get_task_frequency_level(ts,i))? 1: 0;
         }
@@ -357,7 +554,7 @@ static int get_tasks_num_by_freq(struct task_set* ts, freq_level f)
 
 static freq_level get_taskset_lowest_frequency_level(struct task_set* ts)
 {
-    freq_level f = MAX_FREQ_LEVEL;
+    freq_level f = get_max_frequency_level(ts);
     int i = 0;
 
     for(i=num_tasks(ts)-1; i>=0; i--) {
@@ -385,20 +582,26 @@ static struct task_set* set_lowest_freq_level_for_each_task(struct task_set* ts)
     return ts_lowest;
 }
 
+static struct task_set* fp_ptdvs_assign(struct task_set* ts_old)
+{
+    struct task_set* ts = copy_task_set(ts_old);
+
+    set_taskset_MPTA(ts);
+    set_lowest_freq_level_for_all_tasks(ts);
+    return set_lowest_freq_level_for_each_task(ts);
+}
+
 static void do_fp_ptdvs(struct task_set* ts_old)
 {
     static int count = 0;
-    struct task_set* ts = copy_task_set(ts_old);
+    struct task_set* ts = NULL;
 
     fprintf(power_fp, "%f\t ",utilization_set(ts_old));
     fprintf(log_fp,"FP_PTDVS do %d times.\n",++count);
     fprintf(log_fp,"Origin Taskset.\n");
-    fprint_task_set (ts, log_fp);
-    set_taskset_MPTA(ts);
-
-    set_lowest_freq_level_for_all_tasks(ts);
+    fprint_task_set (ts_old, log_fp);
 
-    ts = set_lowest_freq_level_for_each_task(ts);
+    ts = fp_ptdvs_assign(ts_old);
 
     fprintf(log_fp,"Final Taskset.\n");
     assert(feasible(ts, TRUE)==num_tasks(ts));
@@ -463,14 +666,21 @@ static void do_ee_fppt(struct task_set* ts_old)
     set_taskset_IPTA(ts);
 
     for(i=num_tasks(ts)-1; i>=0; i--) {
-        while((feasible(ts, TRUE)==num_tasks(ts))&&
-              (MIN_FREQ_LEVEL!=get_task_frequency_level(ts,i))) {
-            old_f_level = get_task_frequency_level(ts,i);
-            dec_task_frequency_level(ts,i);
+        freq_level f = get_task_frequency_level(ts,i);
+        if(!is_taskset_feasible(ts)) {
+            break;
+        }
+        if(lowest_useful_level(ts) < f) {
+            f = lowest_feasible_level(ts, i, lowest_useful_level(ts), f,
+                                      feasible_with_task_at);
         }
-        if(feasible(ts, TRUE)!=num_tasks(ts)) {
+        if(f > lowest_useful_level(ts)) {
+            // the next level down is the first that fails
+            old_f_level = f;
+            set_task_frequency_level(ts,i,f-1);
             break;
         }
+        set_task_frequency_level(ts,i,f);
     }
 
     if(i>=0) {
@@ -487,6 +697,477 @@ static void do_ee_fppt(struct task_set* ts_old)
     free_task_set(ts);
 }
 
+/*
+ * Exact frequency assignment by branch and bound, as a baseline for
+ * the heuristics.  Energy is that of compute_energy over
+ * SIMULATE_TIME, less the constant idle part.
+ *
+ * A level slower than a task's cheapest one costs more and is harder
+ * to schedule, so each task's domain runs from its cheapest level (or
+ * its slowest feasible one with everything else at full speed, if
+ * that is faster) up to full speed.  Tasks are fixed one at a time,
+ * fastest level first, while the rest stay at full speed; since
+ * slowing down never helps feasibility, the first infeasible level
+ * cuts off all slower ones.  Nodes are bounded by the discrete
+ * knapsack on utilization, solved once for every suffix of the task
+ * order.  A node whose free tasks can all sit at the slowest level of
+ * their domains is solved outright, but only if that level is also
+ * the cheapest in each of those domains; when a task's domain starts
+ * above its cheapest level, a faster level may cost less.  Cheap
+ * necessary conditions (utilization, processor demand, first-job start
+ * times) screen candidates before the threshold assignment.
+ *
+ * OPT_MAX_NODES bounds the search; if it runs out, the best
+ * assignment found so far is returned and is not known to be optimal.
+ */
+#define OPT_MAX_TASKS        (FCACHE_MAX_TASKS)
+#define OPT_GRID             (4000)
+
+long OPT_MAX_NODES = 200000;
+
+struct opt_search {
+    struct task_set* ts;
+    int n;
+    freq_level top;
+    int order[OPT_MAX_TASKS];
+    energy_value e[OPT_MAX_TASKS][MAX_DVFS_LEVELS];
+    double u[OPT_MAX_TASKS][MAX_DVFS_LEVELS];
+    freq_level lo[OPT_MAX_TASKS];
+    int lo_cheapest[OPT_MAX_TASKS];   // no level in lo..top costs less than lo
+    energy_value suffix[OPT_MAX_TASKS+1][OPT_GRID+1];
+    energy_value best;
+    freq_level best_f[OPT_MAX_TASKS];
+    long nodes;
+    int complete;
+};
+
+static energy_value opt_task_cost(struct task_set* ts, int t, freq_level f)
+{
+    time_value T = get_period(ts,t);
+    double jobs = (double)((SIMULATE_TIME + T - 1) / T);
+    time_value C = modify_task_C_by_freq(get_Cu(ts,t), get_frequency_scale(ts,f));
+
+    return compute_task_energy(ts,t,f,SIMULATE_TIME,NULL) - jobs*C*get_dvfs_profile(ts)->idle_power;
+}
+
+/*
+ * conditions any feasible assignment meets: utilization at most 1,
+ * processor demand of the synchronous busy period at each deadline,
+ * and, since with synchronous release no task starts before the
+ * higher-priority jobs released so far are done, each task's first
+ * job starting early enough to finish by its deadline
+ */
+static int opt_necessary(struct opt_search* s)
+{
+    struct task_set* ts = s->ts;
+    double u = 0;
+    int i = 0;
+    int j = 0;
+
+    for(i=0; i<s->n; i++) {
+        u += s->u[i][get_task_frequency_level(ts,i)];
+    }
+    if(u > 1.0) {
+        return FALSE;
+    }
+
+    for(i=0; i<s->n; i++) {
+        time_value t = get_deadline(ts,i);
+        time_value demand = 0;
+        time_value start = 0;
+        time_value prev = -1;
+
+        for(j=0; j<s->n; j++) {
+            if(get_deadline(ts,j) <= t) {
+                demand += ((t-get_deadline(ts,j))/get_period(ts,j)+1)*get_wcet(ts,j);
+            }
+        }
+        if(demand > t) {
+            return FALSE;
+        }
+
+        while((start!=prev) && (start+get_wcet(ts,i)<=t)) {
+            prev = start;
+            start = 0;
+            for(j=0; j<s->n; j++) {
+                if(get_pri(ts,j)<get_pri(ts,i)) {
+                    start += (1+prev/get_period(ts,j))*get_wcet(ts,j);
+                }
+            }
+        }
+        if(start+get_wcet(ts,i) > t) {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static int opt_feasible(struct opt_search* s)
+{
+    return opt_necessary(s) && set_taskset_IPTA(s->ts);
+}
+
+static energy_value opt_cost(struct opt_search* s)
+{
+    energy_value cost = 0;
+    int i = 0;
+
+    for(i=0; i<s->n; i++) {
+        cost += s->e[i][get_task_frequency_level(s->ts,i)];
+    }
+    return cost;
+}
+
+static void opt_record(struct opt_search* s)
+{
+    energy_value cost = opt_cost(s);
+    int i = 0;
+
+    if(cost < s->best) {
+        s->best = cost;
+        for(i=0; i<s->n; i++) {
+            s->best_f[i] = get_task_frequency_level(s->ts,i);
+        }
+    }
+}
+
+/*
+ * suffix[d][c]: least energy for tasks order[d..n-1] whose
+ * utilizations, rounded down to multiples of 1/OPT_GRID, add up to at
+ * most c/OPT_GRID.  Rounding down only loosens the constraint.
+ */
+static void opt_build_suffix(struct opt_search* s)
+{
+    int d = 0;
+    int c = 0;
+    freq_level f = 0;
+
+    for(c=0; c<=OPT_GRID; c++) {
+        s->suffix[s->n][c] = 0;
+    }
+    for(d=s->n-1; d>=0; d--) {
+        int t = s->order[d];
+        for(c=0; c<=OPT_GRID; c++) {
+            energy_value best = HUGE_VAL;
+            for(f=s->lo[t]; f<=s->top; f++) {
+                int w = (int)floor(s->u[t][f]*OPT_GRID);
+                if((w<=c) && (s->e[t][f]+s->suffix[d+1][c-w] < best)) {
+                    best = s->e[t][f]+s->suffix[d+1][c-w];
+                }
+            }
+            s->suffix[d][c] = best;
+        }
+    }
+}
+
+/*
+ * lower bound on any completion of the first depth tasks in order
+ */
+static energy_value opt_bound(struct opt_search* s, int depth)
+{
+    double spare = 1.0;
+    energy_value lb = 0;
+    int i = 0;
+
+    for(i=0; i<depth; i++) {
+        int t = s->order[i];
+        freq_level f = get_task_frequency_level(s->ts,t);
+        spare -= s->u[t][f];
+        lb += s->e[t][f];
+    }
+    if(spare < 0) {
+        return HUGE_VAL;
+    }
+
+    return lb + s->suffix[depth][(int)floor(spare*OPT_GRID)];
+}
+
+/*
+ * tasks order[depth..] are at full speed on entry and on return
+ */
+static void opt_search_depth(struct opt_search* s, int depth)
+{
+    int t = 0;
+    int i = 0;
+    int solved = FALSE;
+    int shortcut = TRUE;
+    freq_level f = 0;
+
+    if(OPT_MAX_NODES && (s->nodes >= OPT_MAX_NODES)) {
+        s->complete = FALSE;
+        return;
+    }
+    s->nodes++;
+
+    if(depth==s->n) {
+        opt_record(s);
+        return;
+    }
+
+    for(i=depth; i<s->n; i++) {
+        if(!s->lo_cheapest[s->order[i]]) {
+            shortcut = FALSE;
+        }
+    }
+    if(shortcut) {
+        for(i=depth; i<s->n; i++) {
+            set_task_frequency_level(s->ts,s->order[i],s->lo[s->order[i]]);
+        }
+        if(opt_feasible(s)) {
+            opt_record(s);
+            solved = TRUE;
+        }
+        for(i=depth; i<s->n; i++) {
+            set_task_frequency_level(s->ts,s->order[i],s->top);
+        }
+        if(solved) {
+            return;
+        }
+    }
+
+    t = s->order[depth];
+    for(f=s->top; f>=s->lo[t]; f--) {
+        energy_value lb = 0;
+
+        set_task_frequency_level(s->ts,t,f);
+        lb = opt_bound(s, depth+1);
+        if(HUGE_VAL==lb) {
+            break;
+        }
+        if(lb >= s->best) {
+            continue;
+        }
+        if((f<s->top) && !opt_feasible(s)) {
+            break;
+        }
+        opt_search_depth(s, depth+1);
+    }
+    set_task_frequency_level(s->ts,t,s->top);
+}
+
+/*
+ * a good starting point makes the bound bite much sooner: slow all
+ * tasks down together as far as possible, then keep taking the
+ * feasible one-level slowdown that saves the most energy per unit of
+ * utilization, then trade one task's slowdown for another's while
+ * that saves energy
+ */
+static void opt_descend(struct opt_search* s)
+{
+    freq_level level = s->top;
+    int improved = TRUE;
+    int i = 0;
+    int j = 0;
+
+    while(level > MIN_FREQ_LEVEL) {
+        for(i=0; i<s->n; i++) {
+            set_task_frequency_level(s->ts,i,(level-1>s->lo[i])? level-1: s->lo[i]);
+        }
+        if(!opt_feasible(s)) {
+            break;
+        }
+        level--;
+    }
+    for(i=0; i<s->n; i++) {
+        set_task_frequency_level(s->ts,i,(level>s->lo[i])? level: s->lo[i]);
+    }
+
+    while(TRUE) {
+        int best_task = -1;
+        double best_ratio = 0;
+
+        for(i=0; i<s->n; i++) {
+            freq_level f = get_task_frequency_level(s->ts,i);
+            double ratio = 0;
+            if(f==s->lo[i]) {
+                continue;
+            }
+            ratio = (s->e[i][f]-s->e[i][f-1])/(s->u[i][f-1]-s->u[i][f]+1e-9);
+            if(ratio<=best_ratio) {
+                continue;
+            }
+            set_task_frequency_level(s->ts,i,f-1);
+            if(opt_feasible(s)) {
+                best_task = i;
+                best_ratio = ratio;
+            }
+            set_task_frequency_level(s->ts,i,f);
+        }
+        if(best_task<0) {
+            break;
+        }
+        dec_task_frequency_level(s->ts,best_task);
+    }
+
+    while(improved) {
+        improved = FALSE;
+        for(i=0; (i<s->n)&&!improved; i++) {
+            freq_level fi = get_task_frequency_level(s->ts,i);
+            if(fi==s->top) {
+                continue;
+            }
+            for(j=0; (j<s->n)&&!improved; j++) {
+                freq_level fj = get_task_frequency_level(s->ts,j);
+                if((j==i) || (fj==s->lo[j]) ||
+                   (s->e[i][fi+1]-s->e[i][fi] >= s->e[j][fj]-s->e[j][fj-1])) {
+                    continue;
+                }
+                set_task_frequency_level(s->ts,i,fi+1);
+                set_task_frequency_level(s->ts,j,fj-1);
+                if(opt_feasible(s)) {
+                    improved = TRUE;
+                }
+                else {
+                    set_task_frequency_level(s->ts,i,fi);
+                    set_task_frequency_level(s->ts,j,fj);
+                }
+            }
+        }
+    }
+
+    s->best = HUGE_VAL;
+    opt_record(s);
+    for(i=0; i<s->n; i++) {
+        set_task_frequency_level(s->ts,i,s->top);
+    }
+}
+
+/*
+ * set ts to a minimum-energy feasible frequency assignment; returns
+ * the number of search nodes, and whether the search finished
+ */
+static long find_optimal_frequencies(struct task_set* ts, int* proven)
+{
+    static struct opt_search s;
+    freq_level f = 0;
+    energy_value range[OPT_MAX_TASKS];
+    int i = 0;
+    int j = 0;
+
+    assert(num_tasks(ts) <= OPT_MAX_TASKS);
+
+    s.ts = copy_task_set(ts);
+    s.n = num_tasks(ts);
+    s.top = get_max_frequency_level(ts);
+    s.nodes = 0;
+    s.complete = TRUE;
+    for(i=0; i<s.n; i++) {
+        set_task_frequency_level(s.ts,i,s.top);
+    }
+    assert(opt_feasible(&s));
+
+    for(i=0; i<s.n; i++) {
+        freq_level lo = MIN_FREQ_LEVEL;
+        freq_level hi = s.top;
+        freq_level cheap = s.top;
+
+        for(f=s.top; f>=MIN_FREQ_LEVEL; f--) {
+            s.e[i][f] = opt_task_cost(ts,i,f);
+            s.u[i][f] = (double)modify_task_C_by_freq(get_Cu(ts,i), get_frequency_scale(ts,f))/get_period(ts,i);
+            if(s.e[i][f] < s.e[i][cheap]) {
+                cheap = f;
+            }
+        }
+
+        // slowest feasible level with the rest at full speed
+        lo = cheap;
+        while(lo < hi) {
+            freq_level mid = (lo+hi)/2;
+            set_task_frequency_level(s.ts,i,mid);
+            if(opt_feasible(&s)) {
+                hi = mid;
+            }
+            else {
+                lo = mid+1;
+            }
+        }
+        set_task_frequency_level(s.ts,i,s.top);
+        s.lo[i] = lo;
+        s.lo_cheapest[i] = TRUE;
+        for(f=lo+1; f<=s.top; f++) {
+            if(s.e[i][f] < s.e[i][lo]) {
+                s.lo_cheapest[i] = FALSE;
+            }
+        }
+        range[i] = s.e[i][s.top]-s.e[i][lo];
+    }
+
+    // the tasks with the most to gain are decided first
+    for(i=0; i<s.n; i++) {
+        for(j=i; (j>0)&&(range[s.order[j-1]]<range[i]); j--) {
+            s.order[j] = s.order[j-1];
+        }
+        s.order[j] = i;
+    }
+
+    opt_build_suffix(&s);
+    opt_descend(&s);
+    opt_search_depth(&s, 0);
+
+    for(i=0; i<s.n; i++) {
+        set_task_frequency_level(ts,i,s.best_f[i]);
+    }
+    free_task_set(s.ts);
+
+    if(proven) {
+        *proven = s.complete;
+    }
+    return s.nodes;
+}
+
+static void do_optimal(struct task_set* ts_old)
+{
+    static int count = 0;
+    struct task_set* ts = copy_task_set(ts_old);
+    long nodes = 0;
+    int proven = FALSE;
+
+    fprintf(power_fp, "%f\t ",utilization_set(ts_old));
+    fprintf(log_fp,"OPTIMAL do %d times.\n",++count);
+    fprintf(log_fp,"Origin Taskset.\n");
+    fprint_task_set (ts, log_fp);
+
+    nodes = find_optimal_frequencies(ts, &proven);
+    set_taskset_MPTA(ts);
+
+    fprintf(log_fp,"Final Taskset (%s after %ld nodes, energy %f).\n",
+            (proven)? "optimal": "best found", nodes,
+            compute_energy(ts, SIMULATE_TIME, NULL));
+    assert(feasible(ts, TRUE)==num_tasks(ts));
+    fprint_task_set (ts, log_fp);
+
+    simulate_power(ts, SIMULATE_TIME, power_fp);
+    free_task_set(ts);
+}
+
+/*
+ * Priorities, thresholds and frequency levels annealed together for
+ * the least energy per hyperperiod, starting from FP_PTDVS's
+ * assignment, so the INORDER priorities are no longer fixed.
+ */
+static void do_joint(struct task_set* ts_old)
+{
+    static int count = 0;
+    struct task_set* ts = fp_ptdvs_assign(ts_old);
+    double scale = 0;
+
+    fprintf(power_fp, "%f\t ",utilization_set(ts_old));
+    fprintf(log_fp,"JOINT do %d times.\n",++count);
+    fprintf(log_fp,"Origin Taskset.\n");
+    fprint_task_set (ts_old, log_fp);
+
+    ts = minimize_energy_by_annealing(ts, &scale);
+
+    fprintf(log_fp,"Final Taskset (energy %f, critical scale %f).\n",
+            compute_energy(ts, SIMULATE_TIME, NULL), scale);
+    assert(feasible(ts, TRUE)==num_tasks(ts));
+    fprint_task_set (ts, log_fp);
+
+    simulate_power(ts, SIMULATE_TIME, power_fp);
+    free_task_set(ts);
+}
+
 static int get_task_by_cu_sort(struct task_set* ts, int n)
 {
     assert(n>=0);
@@ -526,7 +1207,7 @@ static void do_greedy(struct task_set* ts_old)
     static int count = 0;
     struct task_set* ts = copy_task_set(ts_old);
     int i = 0;
-    freq_level old_f_level = MAX_FREQ_LEVEL;
+    freq_level old_f_level = get_max_frequency_level(ts);
 
     fprintf(power_fp, "%f\t ",utilization_set(ts_old));
     fprintf(log_fp,"GREEDY do %d times.\n",++count);
@@ -536,15 +1217,20 @@ static void do_greedy(struct task_set* ts_old)
 
     for(i=0; i<num_tasks(ts); i++) {
         int task = get_task_by_cu_sort(ts,i);
-        while((feasible(ts, TRUE)==num_tasks(ts))&&
-              (MIN_FREQ_LEVEL!=get_task_frequency_level(ts,task))) {
-            old_f_level = get_task_frequency_level(ts,task);
-            dec_task_frequency_level(ts,task);
-        }
-        if(feasible(ts, TRUE)!=num_tasks(ts)) {
+        freq_level f = get_task_frequency_level(ts,task);
+        if(!is_taskset_feasible(ts)) {
             set_task_frequency_level(ts, task, old_f_level);
             break;
         }
+        if(lowest_useful_level(ts) < f) {
+            f = lowest_feasible_level(ts, task, lowest_useful_level(ts), f,
+                                      feasible_with_task_at);
+        }
+        set_task_frequency_level(ts, task, f);
+        if(f > lowest_useful_level(ts)) {
+            // one level lower fails; the original search stopped there
+            break;
+        }
     }
 
     fprintf(log_fp,"Final Taskset.\n");
@@ -555,69 +1241,383 @@ static void do_greedy(struct task_set* ts_old)
     free_task_set(ts);
 }
 
-int main(int argc, char* argv[])
+/*
+ * FP_PTDVS's static assignment, simulated with jobs finishing early
+ * under each runtime policy in turn.  Every policy sees the same
+ * random draws.
+ */
+#define DYN_AET_MIN          (0.5)
+
+static const struct sim_dvs_policy* dyn_policies[] = {
+    NULL, &sim_dvs_cycle_conserving, &sim_dvs_stretch, &sim_dvs_slack
+};
+
+#define DYN_POLICIES         ((int)(sizeof(dyn_policies)/sizeof(dyn_policies[0])))
+
+static void do_dynamic(struct task_set* ts_old)
+{
+    static int count = 0;
+    struct task_set* ts = fp_ptdvs_assign(ts_old);
+    struct spak_rng* rng = spak_rng_current();
+    struct spak_rng saved;
+    int p = 0;
+
+    if(rng) {
+        saved = *rng;
+    }
+    set_task_set_aet(ts, AET_UNIFORM, DYN_AET_MIN, 1.0);
+
+    fprintf(power_fp, "%f",utilization_set(ts_old));
+    fprintf(log_fp,"DYNAMIC do %d times.\n",++count);
+    fprint_task_set (ts, log_fp);
+
+    for(p=0; p<DYN_POLICIES; p++) {
+        energy_value e = 0;
+
+        if(rng) {
+            *rng = saved;
+        }
+        SIM_DVS_POLICY = dyn_policies[p];
+        e = simulate_energy(ts, SIMULATE_TIME);
+        SIM_DVS_POLICY = NULL;
+
+        fprintf(power_fp, "\t%f\t%d", e, sim_last_misses());
+        fprintf(log_fp,"%s: energy %f, %d misses\n",
+                (dyn_policies[p])? dyn_policies[p]->name: "static",
+                e, sim_last_misses());
+    }
+    fprintf(power_fp, "\n");
+
+    free_task_set(ts);
+}
+
+/*
+ * The utilization sweep.  Each utilization point is a shard, run by a
+ * forked worker into its own files under the sweep directory; the
+ * analysis and simulator keep global state, so workers are processes
+ * rather than threads.  Every task set draws from its own stream,
+ * fixed by its place in the sweep, so results do not depend on the
+ * number of workers or on how often the sweep was interrupted.  A
+ * shard is marked done only once its files are complete, so a rerun
+ * repeats just the unfinished shards and then merges all of them, in
+ * order, into the usual files.
+ */
+#define SWEEP_U_STEP         (0.05)
+#define SWEEP_POINTS         (39)
+#define SWEEP_SETS           (100)
+#define SWEEP_SEED           (2015)
+#define SWEEP_METHODS        (6)
+#define SWEEP_PATHLEN        (1024)
+
+static const char* sweep_methods[SWEEP_METHODS] = {
+    "fp_ptdvs", "ee_fppt", "greedy", "optimal", "dynamic", "joint"
+};
+
+static void (*sweep_do[SWEEP_METHODS])(struct task_set*) = {
+    do_fp_ptdvs, do_ee_fppt, do_greedy, do_optimal, do_dynamic, do_joint
+};
+
+static void sweep_header(FILE* fp, int m)
 {
-    max_resp = 100000;     //max response time
-    ANNEAL_MAX = 10000;
-    INIT_TEMP = 0.03;
-    TEMP_SCALE = 0.99;
-    double u = 0;
-    static struct task_set* ts = NULL;
     int i = 0;
 
-    FILE* fp_ptdvs_log_fp = fopen("fp_ptdvs.log","w");
-    FILE* ee_fppt_log_fp = fopen("ee_fppt.log","w");
-    FILE* greedy_log_fp = fopen("greedy.log","w");
-    FILE* fp_ptdvs_power_fp = fopen("fp_ptdvs.power","w");
-    FILE* ee_fppt_power_fp = fopen("ee_fppt.power","w");
-    FILE* greedy_power_fp = fopen("greedy.power","w");
-    fprintf(fp_ptdvs_power_fp, "usage\ttime\tenergy\tdispatch\n");
-    fprintf(ee_fppt_power_fp, "usage\ttime\tenergy\tdispatch\n");
-    fprintf(greedy_power_fp, "usage\ttime\tenergy\tdispatch\n");
-#if 1
-    for(u=0.05; u<2; u+=0.05) {
-        for(i=0; i<100; i++) {
-            ts = create_radom_task_set_by_utilization(u);
+    if(sweep_do[m]==do_dynamic) {
+        fprintf(fp, "usage\tstatic\tmisses\tcycle_conserving\tmisses\tstretch\tmisses\tslack\tmisses\n");
+        return;
+    }
+    // the columns simulate_power writes
+    fprintf(fp, "usage\ttime\tenergy\tdispatch\tswitch\tfswitch");
+    for(i=0; i<TOTAL_TASKS_NUMBER; i++) {
+        fprintf(fp, "\tt%d_preempt\tt%d_fswitch", i, i);
+    }
+    fprintf(fp, "\n");
+}
 
-            log_fp = fp_ptdvs_log_fp;
-            power_fp = fp_ptdvs_power_fp;
-            do_fp_ptdvs(ts);
+static void sweep_path(char* path, const char* dir, const char* what, int shard, const char* ext)
+{
+    snprintf(path, SWEEP_PATHLEN, "%s/%s.%02d.%s", dir, what, shard, ext);
+}
+
+static int sweep_shard_done(const char* dir, int shard)
+{
+    char path[SWEEP_PATHLEN];
+    struct stat st;
 
-            log_fp = ee_fppt_log_fp;
-            power_fp = ee_fppt_power_fp;
-            do_ee_fppt(ts);
+    sweep_path(path, dir, "shard", shard, "done");
+    return 0==stat(path, &st);
+}
 
-            log_fp = greedy_log_fp;
-            power_fp = greedy_power_fp;
-            do_greedy(ts);
+static int sweep_run_shard(const char* dir, int shard, const struct dvfs_profile* profile)
+{
+    char path[SWEEP_PATHLEN];
+    FILE* logs[SWEEP_METHODS];
+    FILE* powers[SWEEP_METHODS];
+    double u = (shard+1)*SWEEP_U_STEP;
+    int m = 0;
+    int i = 0;
 
-            free_task_set(ts);
+    for(m=0; m<SWEEP_METHODS; m++) {
+        sweep_path(path, dir, sweep_methods[m], shard, "log");
+        logs[m] = fopen(path,"w");
+        powers[m] = NULL;
+        if(NULL!=logs[m]) {
+            sweep_path(path, dir, sweep_methods[m], shard, "power");
+            powers[m] = fopen(path,"w");
+        }
+        if((NULL==logs[m]) || (NULL==powers[m])) {
+            fprintf(stderr,"cannot write %s\n",path);
+            if(NULL!=logs[m]) {
+                fclose(logs[m]);
+            }
+            while(m-- > 0) {
+                fclose(logs[m]);
+                fclose(powers[m]);
+            }
+            return FALSE;
+        }
+    }
+
+    for(i=0; i<SWEEP_SETS; i++) {
+        struct spak_rng rng;
+        struct spak_rng* old = NULL;
+        struct task_set* ts = NULL;
+
+        spak_rng_init(&rng, SWEEP_SEED, (uint64_t)shard*SWEEP_SETS+i);
+        old = spak_rng_select(&rng);
+        ts = create_radom_task_set_by_utilization(u);
+        if(profile) {
+            set_dvfs_profile(ts, profile);
+        }
+        fcache_reset();
+
+        for(m=0; m<SWEEP_METHODS; m++) {
+            log_fp = logs[m];
+            power_fp = powers[m];
+            sweep_do[m](ts);
+        }
+
+        free_task_set(ts);
+        spak_rng_select(old);
+    }
+
+    for(m=0; m<SWEEP_METHODS; m++) {
+        if((0!=fclose(logs[m])) | (0!=fclose(powers[m]))) {
+            return FALSE;
+        }
+    }
+
+    sweep_path(path, dir, "shard", shard, "done");
+    logs[0] = fopen(path,"w");
+    return (NULL!=logs[0]) && (0==fclose(logs[0]));
+}
+
+static int sweep_append(FILE* out, const char* path)
+{
+    char buf[BUFSIZ];
+    size_t len = 0;
+    FILE* in = fopen(path,"r");
+
+    if(NULL==in) {
+        fprintf(stderr,"cannot read %s\n",path);
+        return FALSE;
+    }
+    while((len = fread(buf, 1, sizeof(buf), in)) > 0) {
+        fwrite(buf, 1, len, out);
+    }
+    fclose(in);
+    return TRUE;
+}
+
+static int sweep_merge(const char* dir)
+{
+    char path[SWEEP_PATHLEN];
+    int ok = TRUE;
+    int m = 0;
+    int k = 0;
+
+    for(m=0; m<SWEEP_METHODS; m++) {
+        FILE* log = NULL;
+        FILE* power = NULL;
+
+        snprintf(path, SWEEP_PATHLEN, "%s.log", sweep_methods[m]);
+        log = fopen(path,"w");
+        snprintf(path, SWEEP_PATHLEN, "%s.power", sweep_methods[m]);
+        power = fopen(path,"w");
+        if((NULL==log) || (NULL==power)) {
+            fprintf(stderr,"cannot write %s\n",path);
+            return FALSE;
+        }
+        sweep_header(power, m);
+
+        for(k=0; k<SWEEP_POINTS; k++) {
+            sweep_path(path, dir, sweep_methods[m], k, "log");
+            ok = sweep_append(log, path) && ok;
+            sweep_path(path, dir, sweep_methods[m], k, "power");
+            ok = sweep_append(power, path) && ok;
+        }
+        fclose(log);
+        fclose(power);
+    }
+    return ok;
+}
+
+static int sweep(const char* dir, int workers, const struct dvfs_profile* profile)
+{
+    int running = 0;
+    int failed = 0;
+    int status = 0;
+    int k = 0;
+
+    if((0!=mkdir(dir, 0777)) && (EEXIST!=errno)) {
+        fprintf(stderr,"cannot create %s\n",dir);
+        return FALSE;
+    }
+    fflush(stdout);
+
+    for(k=0; k<=SWEEP_POINTS; k++) {
+        pid_t pid = 0;
+
+        // wait for a free worker, or for all of them after the last shard
+        while((running>0) && ((running>=workers) || (k==SWEEP_POINTS))) {
+            if(wait(&status) < 0) {
+                break;
+            }
+            running--;
+            if(!WIFEXITED(status) || (0!=WEXITSTATUS(status))) {
+                failed++;
+            }
+        }
+        if((k==SWEEP_POINTS) || sweep_shard_done(dir, k)) {
+            continue;
+        }
+
+        pid = fork();
+        if(pid < 0) {
+            fprintf(stderr,"cannot start a worker\n");
+            failed++;
+            break;
+        }
+        if(0==pid) {
+            int ok = sweep_run_shard(dir, k, profile);
+            printf("u=%.2f %s\n", (k+1)*SWEEP_U_STEP, (ok)? "done": "failed");
+            fcache_print_stats(stdout);
+            fflush(stdout);
+            _exit((ok)? 0: 1);
+        }
+        running++;
+    }
+    while(running>0 && wait(&status)>=0) {
+        running--;
+        if(!WIFEXITED(status) || (0!=WEXITSTATUS(status))) {
+            failed++;
+        }
+    }
+
+    if(failed) {
+        fprintf(stderr,"%d shard(s) failed; rerun to resume\n",failed);
+        return FALSE;
+    }
+    return sweep_merge(dir);
+}
+
+int main(int argc, char* argv[])
+{
+    max_resp = 100000;     //max response time
+    ANNEAL_MAX = 10000;
+    INIT_TEMP = 0.03;
+    TEMP_SCALE = 0.99;
+    struct dvfs_profile* profile = NULL;
+    const char* dir = "sweep";
+    long workers = sysconf(_SC_NPROCESSORS_ONLN);
+    int ret = 0;
+    int opt = 0;
+
+    /*
+     * FP_PTDVS [-j workers] [-d sweep dir] [-s switch time] [-e switch energy]
+     *          [-S frequency switch time] [-E frequency switch energy]
+     *          [processor profile]
+     */
+    while((opt = getopt(argc, argv, "j:d:s:e:S:E:")) != -1) {
+        switch(opt) {
+        case 'j':
+            workers = atol(optarg);
+            break;
+        case 'd':
+            dir = optarg;
+            break;
+        case 's':
+            SIM_SWITCH_TIME = atol(optarg);
+            break;
+        case 'e':
+            SIM_SWITCH_ENERGY = atof(optarg);
+            break;
+        case 'S':
+            SIM_FREQ_SWITCH_TIME = atol(optarg);
+            break;
+        case 'E':
+            SIM_FREQ_SWITCH_ENERGY = atof(optarg);
+            break;
+        default:
+            fprintf(stderr,"usage: %s [-j workers] [-d dir] [-s time] [-e energy] "
+                    "[-S time] [-E energy] [profile]\n",argv[0]);
+            return 1;
+        }
+    }
+    if(workers < 1) {
+        workers = 1;
+    }
+
+    // optional processor profile; the built-in one otherwise
+    if(optind < argc) {
+        profile = load_dvfs_profile(argv[optind]);
+        if(NULL==profile) {
+            fprintf(stderr,"cannot load processor profile %s\n",argv[optind]);
+            return 1;
         }
+        fprint_dvfs_profile(profile, stdout);
     }
+
+#if 1
+    ret = sweep(dir, (int)workers, profile)? 0: 1;
 #else
-    ts = create_special_task_set();
+    {
+        struct task_set* ts = create_special_task_set();
+        FILE* logs[SWEEP_METHODS];
+        FILE* powers[SWEEP_METHODS];
+        char path[SWEEP_PATHLEN];
+        int m = 0;
+
+        if(profile) {
+            set_dvfs_profile(ts, profile);
+        }
+        fcache_reset();
 
-    log_fp = fp_ptdvs_log_fp;
-    power_fp = fp_ptdvs_power_fp;
-    do_fp_ptdvs(ts);
+        for(m=0; m<SWEEP_METHODS; m++) {
+            snprintf(path, SWEEP_PATHLEN, "%s.log", sweep_methods[m]);
+            logs[m] = fopen(path,"w");
+            snprintf(path, SWEEP_PATHLEN, "%s.power", sweep_methods[m]);
+            powers[m] = fopen(path,"w");
+            sweep_header(powers[m], m);
 
-    log_fp = ee_fppt_log_fp;
-    power_fp = ee_fppt_power_fp;
-    do_ee_fppt(ts);
+            log_fp = logs[m];
+            power_fp = powers[m];
+            sweep_do[m](ts);
 
-    log_fp = greedy_log_fp;
-    power_fp = greedy_power_fp;
-    do_greedy(ts);
+            fclose(logs[m]);
+            fclose(powers[m]);
+        }
 
-    free_task_set(ts);
+        free_task_set(ts);
+        fcache_print_stats(stdout);
+    }
 #endif
-    fclose(fp_ptdvs_log_fp);
-    fclose(ee_fppt_log_fp);
-    fclose(greedy_log_fp);
-    fclose(fp_ptdvs_power_fp);
-    fclose(ee_fppt_power_fp);
-    fclose(greedy_power_fp);
+    if(fcache) {
+        ffree(fcache);
+        fcache = NULL;
+    }
+    if(profile) {
+        free_dvfs_profile(profile);
+    }
 
-    return 0;
+    return ret;
 }
-
@@ -10,45 +10,126 @@
 #include <limits.h>
 #include <assert.h>
 #include <time.h>
+#include <stdint.h>
 
 extern int ANNEAL_MAX;
 extern double INIT_TEMP;
 extern double TEMP_SCALE;
 
+/*
+ * with ANNEAL_REPLICAS > 1 the annealers run that many chains, each on
+ * its own thread and random stream.  With ANNEAL_TEMPERING they form a
+ * parallel tempering ladder from ANNEAL_HOT down to ANNEAL_COLD
+ * (fractions of the starting cost) and try to swap neighbours every
+ * ANNEAL_EXCHANGE moves; without it they are independent runs of the
+ * usual annealer and the best result wins.
+ */
+extern int ANNEAL_REPLICAS;
+extern int ANNEAL_TEMPERING;
+extern int ANNEAL_EXCHANGE;
+extern double ANNEAL_HOT;
+extern double ANNEAL_COLD;
+
+// worker threads for the branch and bound in exhaustive()
+extern int EXHAUSTIVE_THREADS;
+
+/*
+ * how a single chain of the annealers searches: SEARCH_ANNEAL is the
+ * annealing they are named for, SEARCH_DESCENT never takes a worse
+ * assignment, and SEARCH_STEEPEST and SEARCH_TABU look at every
+ * neighbour of the current assignment before moving to the best one.
+ * Tabu search takes it even when it is worse, but not if it changes a
+ * task that moved in the last TABU_TENURE steps, unless it beats the
+ * best assignment seen.
+ */
+enum search_strategy {
+    SEARCH_ANNEAL = 0x300,
+    SEARCH_DESCENT,
+    SEARCH_STEEPEST,
+    SEARCH_TABU,
+};
+
+extern int SEARCH_STRATEGY;
+extern int TABU_TENURE;
+
 #define DBGPrint(lev,str) do {      \
         if ((lev)<=DBG_LEVEL) printf str; \
         fflush (stdout);                  \
     } while (0);
 
+/*
+ * counter-based random number streams (Philox4x32-10); a stream is
+ * fully determined by its (seed, stream) pair, so what it produces
+ * doesn't depend on which thread draws from it or on other streams
+ */
+struct spak_rng {
+    uint32_t ctr[4];
+    uint32_t key[2];
+    uint32_t out[4];
+    int used;
+};
+
+extern void spak_rng_init (struct spak_rng* r, uint64_t seed, uint64_t stream);
+
+extern double spak_rng_double (struct spak_rng* r);
+
+extern long int spak_rng_long (struct spak_rng* r);
+
+/*
+ * make r the source of rand_double(), rand_long() and seed_rand() for
+ * the calling thread -- and so for the task set generators, the
+ * annealers and the simulator when called from it; NULL goes back to
+ * the shared C library generator.  Returns the previous stream.
+ */
+extern struct spak_rng* spak_rng_select (struct spak_rng* r);
+
+extern struct spak_rng* spak_rng_current (void);
+
 // just a few things needed to compile using VC++
 #ifdef WIN32
 #pragma warning( disable : 4514 4127 4100 4505 )
 #define inline __inline
 static inline void seed_rand (int s)
 {
-    srand(s);
+    struct spak_rng* r = spak_rng_current ();
+    if (r) {
+        spak_rng_init (r, s, ((uint64_t)r->ctr[3] << 32) | r->ctr[2]);
+    }
+    else {
+        srand(s);
+    }
 }
 static inline long int rand_long (void)
 {
-    return rand();
+    struct spak_rng* r = spak_rng_current ();
+    return (r) ? spak_rng_long (r) : rand();
 }
 static inline double rand_double (void)
 {
-    return ((double)rand()) / RAND_MAX;
+    struct spak_rng* r = spak_rng_current ();
+    return (r) ? spak_rng_double (r) : ((double)rand()) / RAND_MAX;
 }
 #else
 #include <unistd.h>
 static inline double rand_double (void)
 {
-    return drand48();
+    struct spak_rng* r = spak_rng_current ();
+    return (r) ? spak_rng_double (r) : drand48();
 }
 static inline long int rand_long (void)
 {
-    return lrand48();
+    struct spak_rng* r = spak_rng_current ();
+    return (r) ? spak_rng_long (r) : lrand48();
 }
 static inline void seed_rand (int s)
 {
-    srand48(s);
+    struct spak_rng* r = spak_rng_current ();
+    if (r) {
+        spak_rng_init (r, s, ((uint64_t)r->ctr[3] << 32) | r->ctr[2]);
+    }
+    else {
+        srand48(s);
+    }
 }
 #endif
 
@@ -71,13 +152,36 @@ typedef int time_value;
 
 #ifdef USE_DVS
 typedef double freq_scale;
-static freq_scale valid_f_scale[]= {0.1,0.3,0.5,0.7,0.9,1.0};
 typedef int freq_level;
-#define SIZE_OF_ARRAY(a)   ((sizeof(a))/(sizeof(a[0])))
-#define MAX_FREQ_LEVEL       (SIZE_OF_ARRAY(valid_f_scale)-1)
 #define MIN_FREQ_LEVEL       (0)
 typedef double power_value;
 typedef double energy_value;
+
+/*
+ * a processor's operating points, slowest first.  Frequencies are
+ * scaled so that the fastest level is 1.0; execution at level f for
+ * one time unit costs dynamic_power + static_power, and an idle
+ * processor costs idle_power.  Every task set refers to one profile
+ * (the built-in one unless set_dvfs_profile is called) and frequency
+ * levels index into it.
+ */
+#define MAX_DVFS_LEVELS      (32)
+#define MAX_PROFILE_NAMELEN  (64)
+
+struct dvfs_level {
+    freq_scale f;
+    double voltage;
+    power_value dynamic_power;
+    power_value static_power;
+};
+
+struct dvfs_profile {
+    char name[MAX_PROFILE_NAMELEN];
+    int num_levels;
+    struct dvfs_level levels[MAX_DVFS_LEVELS];
+    power_value idle_power;
+    power_value sleep_power;
+};
 #endif
 
 struct task_set;
@@ -143,6 +247,8 @@ extern void set_priorities (struct task_set* ts,
 
 extern int assign_optimal_pri (struct task_set* ts);
 
+extern int assign_robust_pri (struct task_set* ts, double* tolerance);
+
 extern void calculate_blocking_pcp (struct task_set* ts);
 
 extern double utilization_set (struct task_set* ts);
@@ -182,6 +288,30 @@ extern void free_task_set (struct task_set* ts);
 
 extern void normalize_utilization (struct task_set* ts, double norm);
 
+/*
+ * when set, simulations use fixed task phasing and stop simulating
+ * once the schedule is seen to repeat across hyperperiods (task sets
+ * with jitter are always simulated in full)
+ */
+extern int SIM_HYPERPERIOD;
+
+/*
+ * when non-NULL, each simulation appends a per-task summary of the
+ * response time distribution, lateness and preemptions to this file
+ */
+extern FILE* SIM_SUMMARY_FP;
+
+/*
+ * when non-zero, a simulation stops as soon as this many deadline
+ * misses have been counted
+ */
+extern int SIM_MAX_MISSES;
+
+/*
+ * time each dispatch adds to the job being dispatched
+ */
+extern time_value SIM_SWITCH_TIME;
+
 extern void simulate (struct task_set* taskset,
                       time_value end_time,
                       const char* outfile_name,
@@ -189,6 +319,44 @@ extern void simulate (struct task_set* taskset,
                       const char* overrun_str,
                       FILE* miss_file);
 
+/*
+ * number of deadline misses in the most recent simulation
+ */
+extern int sim_last_misses (void);
+
+/*
+ * actual execution times: each job runs for a fraction of its WCET
+ * drawn from its task's distribution, clamped to at most 1, and for
+ * at least one time unit.  Jobs run for their whole WCET by default.
+ * Task sets with sampled execution times are always simulated in full.
+ */
+enum aet_dist {
+    AET_WCET = 0,
+    AET_UNIFORM,     // uniform on [a,b]
+    AET_NORMAL       // mean a, standard deviation b
+};
+
+extern void set_task_aet (struct task_set* ts,
+                          int t,
+                          enum aet_dist dist,
+                          double a,
+                          double b);
+
+extern void set_task_set_aet (struct task_set* ts,
+                              enum aet_dist dist,
+                              double a,
+                              double b);
+
+/*
+ * simulate only until the first deadline miss; if there is one, returns
+ * TRUE along with the missed deadline and the index of the task
+ */
+extern int simulate_first_miss (struct task_set* taskset,
+                                time_value end_time,
+                                double overrun_frac,
+                                time_value* miss_time,
+                                int* miss_task);
+
 extern int wcetcmp (struct task_set* ts1, struct task_set* ts2);
 
 static inline time_value tvmax (time_value tv1,
@@ -245,6 +413,13 @@ extern int get_pri (struct task_set* ts, int i);
 
 extern int assign_optimal_preemption_thresholds (struct task_set* ts);
 
+/*
+ * response time analyses run by assign_optimal_preemption_thresholds,
+ * and how many fewer than a one-step-at-a-time search would have run
+ */
+extern long mpta_rta_calls;
+extern long mpta_rta_calls_saved;
+
 extern int ensure_same_response_times (struct task_set* ts1,
                                        struct task_set* ts2);
 
@@ -260,6 +435,12 @@ extern int exhaustive_assign_optimal_priorities_and_thresholds (struct task_set*
 
 extern int optimal_partition_into_threads (struct task_set* ts);
 
+/*
+ * the thresholds, for ts's priorities, that need the fewest threads;
+ * returns that number, or 0 if no thresholds make ts feasible
+ */
+extern int assign_thresholds_for_fewest_threads (struct task_set* ts);
+
 extern void maximize_preempt_thresholds (struct task_set* ts);
 
 extern void minimize_threads_by_annealing (struct task_set* ts1,
@@ -328,6 +509,20 @@ extern struct task_set* create_random_task_set_with_utilization (int num,
         int has_jitter,
         int has_independent_deadline);
 
+/*
+ * as above, but drawing from the given stream, so the task set depends
+ * only on how the stream was initialized
+ */
+extern struct task_set* create_random_task_set_with_utilization_rng (int num,
+        int total_tasks,
+        int max_deadline,
+        const char* analysis,
+        int multiplier,
+        double set_u,
+        int has_jitter,
+        int has_independent_deadline,
+        struct spak_rng* rng);
+
 extern int compare_preempt_thresh_analyses (struct task_set* ts1);
 
 extern void break_orig_preempt_thresh_analysis (void);
@@ -345,6 +540,8 @@ extern void look_for_p_schedule (struct task_set* ts,
 
 extern time_value get_period (struct task_set* ts, int t);
 
+extern time_value get_deadline (struct task_set* ts, int t);
+
 extern void create_random_task_cluster (struct task_set* ts, int num);
 
 extern int barriers_permit_pri (struct task_set* ts, int t, int pri);
@@ -372,6 +569,16 @@ extern time_value modify_task_C_by_freq(time_value Cu, freq_scale freq);
 
 extern time_value get_Cu(struct task_set* ts, int t);
 
+extern time_value get_task_wcet_at_level (struct task_set* ts, int t, freq_level f);
+
+/*
+ * ee_fppt analysis of ts, with its current priorities and thresholds,
+ * as if task t ran at level f; ts is not modified
+ */
+extern time_value ee_fppt_response_time_at (struct task_set* ts, int i, int t, freq_level f);
+
+extern int ee_fppt_feasible_at (struct task_set* ts, int t, freq_level f);
+
 extern char* get_task_name(struct task_set* ts, int t);
 
 extern int new_dvs_task (struct task_set* ts,
@@ -415,6 +622,30 @@ extern void dec_task_frequency_level(struct task_set* ts, int t);
 
 extern power_value calculate_tast_set_average_power(struct task_set* ts);
 
+extern const struct dvfs_profile* default_dvfs_profile (void);
+
+extern struct dvfs_profile* load_dvfs_profile (const char* fn);
+
+extern struct dvfs_profile* fload_dvfs_profile (FILE* fp);
+
+extern void free_dvfs_profile (struct dvfs_profile* prof);
+
+extern void fprint_dvfs_profile (const struct dvfs_profile* prof, FILE* fp);
+
+extern power_value dvfs_level_power (const struct dvfs_profile* prof, freq_level f);
+
+extern freq_level dvfs_critical_level (const struct dvfs_profile* prof);
+
+extern void set_dvfs_profile (struct task_set* ts, const struct dvfs_profile* prof);
+
+extern const struct dvfs_profile* get_dvfs_profile (struct task_set* ts);
+
+extern freq_level get_max_frequency_level (struct task_set* ts);
+
+extern freq_scale get_frequency_scale (struct task_set* ts, freq_level f);
+
+extern energy_value get_task_job_energy (struct task_set* ts, int t, freq_level f);
+
 extern freq_level get_task_set_frequency_level(struct task_set* ts);
 
 extern void set_task_set_frequency_level(struct task_set* ts, freq_level f);
@@ -423,9 +654,114 @@ extern void inc_task_set_frequency_level(struct task_set* ts);
 
 extern void dec_task_set_frequency_level(struct task_set* ts);
 
+/*
+ * appends end_time, energy, preemptions, dispatches and frequency
+ * switches, then each task's preemptions and frequency switches, as
+ * one tab-separated line
+ */
 void simulate_power (struct task_set* taskset,
                      time_value end_time,
                      FILE* power_fp);
+
+extern energy_value simulate_energy (struct task_set* taskset,
+                                     time_value end_time);
+
+/*
+ * Runtime DVS.  When SIM_DVS_POLICY is set, the simulator asks it for
+ * the level of the running job every time the scheduler runs, instead
+ * of always using the task's own (static) level, and charges energy
+ * at the level actually used.  The hooks may be NULL: start and stop
+ * bracket each simulation, release is called when a job becomes
+ * ready, and complete when one finishes, with the time (at the task's
+ * static level) it had left of its WCET.  Task sets simulated under a
+ * policy are always simulated in full.
+ *
+ * cycle_conserving scales every job by the utilization that jobs
+ * completing early leave unused, stretch (look-ahead to the next
+ * arrival) slows a job that has the processor to itself so that its
+ * worst case ends at the next release, and slack hands the WCET a job
+ * did not use to the job dispatched when it completes, provided that
+ * job is no less preemptible.  stretch and slack never finish a job
+ * later than the static schedule would; cycle_conserving may, so
+ * compare misses as well as energy.
+ */
+struct sim_dvs_policy {
+    const char* name;
+    void (*start) (struct task_set* ts);
+    void (*release) (struct task_set* ts, int t);
+    void (*complete) (struct task_set* ts, int t, time_value slack);
+    freq_level (*level) (struct task_set* ts, int t);
+    void (*stop) (struct task_set* ts);
+};
+
+extern const struct sim_dvs_policy* SIM_DVS_POLICY;
+
+/*
+ * energy of each dispatch, and the time and energy of each change of
+ * level between stretches of execution; the time is added to the job
+ * being switched to
+ */
+extern energy_value SIM_SWITCH_ENERGY;
+
+extern time_value SIM_FREQ_SWITCH_TIME;
+
+extern energy_value SIM_FREQ_SWITCH_ENERGY;
+
+extern const struct sim_dvs_policy sim_dvs_cycle_conserving;
+extern const struct sim_dvs_policy sim_dvs_stretch;
+extern const struct sim_dvs_policy sim_dvs_slack;
+
+/*
+ * for policies: the current time, the next time a job is released,
+ * the worst-case time task t's current job still needs at its static
+ * level, and whether another job is waiting for the processor
+ */
+extern time_value sim_now (void);
+
+extern time_value sim_next_release (void);
+
+extern time_value sim_wc_remaining (struct task_set* ts, int t);
+
+extern int sim_others_waiting (struct task_set* ts, int t);
+
+/*
+ * energy over [0,horizon) in closed form, for strictly periodic task
+ * sets released together at time 0.  Every job released before the
+ * horizon is charged in full, so the result is exact (and matches
+ * simulate_energy with SIM_HYPERPERIOD set) whenever the processor is
+ * idle at the horizon, e.g. at any multiple of the hyperperiod of a
+ * feasible set with D <= T.  prof is indexed by the tasks' frequency
+ * levels; NULL means the task set's own profile.
+ */
+extern energy_value compute_task_energy (struct task_set* ts,
+                                         int t,
+                                         freq_level f,
+                                         time_value horizon,
+                                         const struct dvfs_profile* prof);
+
+extern energy_value compute_energy (struct task_set* ts,
+                                    time_value horizon,
+                                    const struct dvfs_profile* prof);
+
+extern power_value compute_average_power (struct task_set* ts,
+                                          const struct dvfs_profile* prof);
+
+/*
+ * Anneal priorities, preemption thresholds and frequency levels
+ * together, from the feasible assignment in ts, for the least average
+ * power (equivalently, energy per hyperperiod) of a feasible set.
+ * Returns ts at the best assignment found, with R up to date, and its
+ * critical scaling factor in *scale if scale is not NULL.
+ */
+extern struct task_set* minimize_energy_by_annealing (struct task_set* ts,
+                                                      double* scale);
+
+/*
+ * if set, compute_energy also simulates the task set and reports
+ * any disagreement on stdout; only horizons at which the closed form
+ * is exact (see compute_task_energy) are checked
+ */
+extern int ENERGY_CROSS_CHECK;
 #endif
 
 #endif
@@ -198,12 +198,15 @@ static time_value find_start_time (struct task_set *ts, int i, int q)
   }
 }
 
-static time_value find_finish_time (struct task_set *ts, int i, int q)
+/*
+ * only this part depends on task i's preemption threshold
+ */
+static time_value finish_after_start (struct task_set *ts, int i, int q,
+				      time_value start_time)
 {
   int j, rep;
-  time_value start_time, fiq, prev_fiq;
+  time_value fiq, prev_fiq;
 
-  start_time = find_start_time (ts, i, q);
   if (start_time == max_resp) {
     return max_resp;
   }
@@ -250,6 +253,11 @@ static time_value find_finish_time (struct task_set *ts, int i, int q)
   }
 }
 
+static time_value find_finish_time (struct task_set *ts, int i, int q)
+{
+  return finish_after_start (ts, i, q, find_start_time (ts, i, q));
+}
+
 static time_value analysis6_response_time (struct task_set *ts,
 					   int i,
 					   time_value initial_guess)
@@ -295,12 +303,75 @@ static time_value analysis6_response_time (struct task_set *ts,
   }
 }
 
+/*
+ * the busy period, blocking and start times don't depend on task i's
+ * own threshold, so a threshold search can work them out once
+ */
+struct thresh_sweep {
+  int Q;
+  time_value *start;
+};
+
+static void *analysis6_thresh_sweep_start (struct task_set *ts, int i)
+{
+  struct thresh_sweep *sw = (struct thresh_sweep *) xmalloc (sizeof (struct thresh_sweep));
+  int q;
+
+  sw->Q = findQ (ts, i);
+  sw->start = NULL;
+  if (sw->Q == max_resp) return sw;
+
+  sw->start = (time_value *) xmalloc ((sw->Q + 1) * sizeof (time_value));
+  for (q=0; q<=sw->Q; q++) {
+    sw->start[q] = find_start_time (ts, i, q);
+  }
+
+  return sw;
+}
+
+static time_value analysis6_thresh_sweep_response_time (struct task_set *ts,
+							int i,
+							void *p)
+{
+  struct thresh_sweep *sw = (struct thresh_sweep *) p;
+  time_value ri, max_ri;
+  int q;
+
+  if (sw->Q == max_resp) return max_resp;
+
+  max_ri = 0;
+  for (q=0; q<=sw->Q; q++) {
+    ri = finish_after_start (ts, i, q, sw->start[q]) + 
+      ts->tasks[i].J - (q*ts->tasks[i].T);
+    if (ri > max_ri) {
+      max_ri = ri;
+    }
+  }
+
+  if (max_ri < max_resp) {
+    return max_ri;
+  } else {
+    return max_resp;
+  }
+}
+
+static void analysis6_thresh_sweep_end (void *p)
+{
+  struct thresh_sweep *sw = (struct thresh_sweep *) p;
+
+  if (sw->start) xfree (sw->start);
+  xfree (sw);
+}
+
 int get_analysis6_ptrs (const char *id,
 			struct spak_analysis *A)
 {
   if (strcmp (id, "Wang00_fixed") == 0) {
     A->valid = analysis6_valid;
     A->response_time = analysis6_response_time;
+    A->thresh_sweep_start = analysis6_thresh_sweep_start;
+    A->thresh_sweep_response_time = analysis6_thresh_sweep_response_time;
+    A->thresh_sweep_end = analysis6_thresh_sweep_end;
     return TRUE;
   } else {
     return FALSE;
@@ -32,6 +32,41 @@
 #define DBG_LEVEL 2
 #define FINDL_LEVEL 3
 
+/*
+ * a what-if query runs the analysis as though what_if_task ran at
+ * what_if_level, taking its C from the task's per-level table instead
+ * of changing the task set
+ */
+#ifdef USE_DVS
+#ifdef WIN32
+static __declspec(thread) int what_if_task = -1;
+static __declspec(thread) freq_level what_if_level;
+#else
+static __thread int what_if_task = -1;
+static __thread freq_level what_if_level;
+#endif
+#endif
+
+/*
+ * when only schedulability matters, a job's fixpoints stop as soon as
+ * they pass the job's deadline, and so does the search over jobs
+ */
+#ifdef WIN32
+static __declspec(thread) int deadline_bounded;
+#else
+static __thread int deadline_bounded;
+#endif
+
+static inline time_value wcet (struct task_set* ts, int j)
+{
+#ifdef USE_DVS
+    if (j == what_if_task) {
+        return ts->tasks[j].Cf[what_if_level];
+    }
+#endif
+    return ts->tasks[j].C;
+}
+
 static int analysis7_valid (struct task_set* ts)
 {
     if (max_resp == -1) {
@@ -66,12 +101,12 @@ static time_value find_max_block (struct task_set* ts, int i)
         if (ts->tasks[j].PT <= ts->tasks[i].P &&
             (ts->tasks[i].P <= ts->tasks[j].P && i!=j)) {
 #if 0
-            if (ts->tasks[j].C > maxb) {
-                maxb = ts->tasks[j].C;
+            if (wcet (ts, j) > maxb) {
+                maxb = wcet (ts, j);
             }
 #else
-            if (ts->tasks[j].C-1 > maxb) {
-                maxb = ts->tasks[j].C-1;
+            if (wcet (ts, j)-1 > maxb) {
+                maxb = wcet (ts, j)-1;
             }
 #endif
         }
@@ -109,12 +144,12 @@ static int findL (struct task_set* ts, int i)
                 int term;
 
                 // FIXME: not sure which line is right
-                term = div_ceil (oldLi + ts->tasks[j].J, ts->tasks[j].T) * ts->tasks[j].C;
-                // term = div_ceil (oldLi, ts->tasks[j].T) * ts->tasks[j].C;
+                term = div_ceil (oldLi + ts->tasks[j].J, ts->tasks[j].T) * wcet (ts, j);
+                // term = div_ceil (oldLi, ts->tasks[j].T) * wcet (ts, j);
 
                 DBGPrint (FINDL_LEVEL, (" + (div_ceil(%d + %d, %d)*%d\n",
                                         oldLi, ts->tasks[j].J,
-                                        ts->tasks[j].T, ts->tasks[j].C));
+                                        ts->tasks[j].T, wcet (ts, j)));
                 // DBGPrint (FINDL_LEVEL, (" + %d", term));
                 Li += term;
             }
@@ -154,7 +189,7 @@ static int findQ (struct task_set* ts, int i)
     }
 }
 
-static time_value find_start_time (struct task_set* ts, int i, int q)
+static time_value find_start_time (struct task_set* ts, int i, int q, time_value limit)
 {
     time_value siq, prev_siq;
     int j;
@@ -162,27 +197,27 @@ static time_value find_start_time (struct task_set* ts, int i, int q)
     siq = 0;
     do {
         prev_siq = siq;
-        siq = find_max_block (ts, i) + (q * ts->tasks[i].C);
+        siq = find_max_block (ts, i) + (q * wcet (ts, i));
 
         DBGPrint (5, ("        siq(%d) = %d + %d = %d\n",
                       q,
                       find_max_block (ts, i),
-                      (q * ts->tasks[i].C),
+                      (q * wcet (ts, i)),
                       siq));
 
         for (j=0; j<ts->num_tasks; j++) {
             if (ts->tasks[j].P <= ts->tasks[i].P && i != j) {
                 time_value add =
-                    (1 + div_floor (prev_siq + ts->tasks[j].J, ts->tasks[j].T)) * ts->tasks[j].C;
+                    (1 + div_floor (prev_siq + ts->tasks[j].J, ts->tasks[j].T)) * wcet (ts, j);
                 siq += add;
                 DBGPrint (5, ("          + %d\n", add));
             }
         }
         DBGPrint (5, ("          = %d\n", siq));
     }
-    while (siq != prev_siq && siq < max_resp);
+    while (siq != prev_siq && siq < limit);
 
-    if (siq < max_resp) {
+    if (siq < limit) {
         return siq;
     }
     else {
@@ -190,12 +225,15 @@ static time_value find_start_time (struct task_set* ts, int i, int q)
     }
 }
 
-static time_value find_finish_time (struct task_set* ts, int i, int q)
+/*
+ * only this part depends on task i's preemption threshold
+ */
+static time_value finish_after_start (struct task_set* ts, int i, int q,
+                                      time_value start_time, time_value limit)
 {
     int j, rep;
-    time_value start_time, fiq, prev_fiq;
+    time_value fiq, prev_fiq;
 
-    start_time = find_start_time (ts, i, q);
     if (start_time == max_resp) {
         return max_resp;
     }
@@ -211,11 +249,11 @@ static time_value find_finish_time (struct task_set* ts, int i, int q)
 
         prev_fiq = fiq;
 
-        fiq = start_time + ts->tasks[i].C;
+        fiq = start_time + wcet (ts, i);
         DBGPrint (5, ("        fiq(%d) = %d + %d = %d\n",
                       q,
                       start_time,
-                      ts->tasks[i].C,
+                      wcet (ts, i),
                       fiq));
 
         for (j=0; j<ts->num_tasks; j++) {
@@ -223,20 +261,20 @@ static time_value find_finish_time (struct task_set* ts, int i, int q)
                 time_value add =
                     (div_ceil (prev_fiq + ts->tasks[j].J, ts->tasks[j].T) -
                      (1 + div_floor (start_time + ts->tasks[j].J, ts->tasks[j].T)))
-                    * ts->tasks[j].C;
+                    * wcet (ts, j);
                 fiq += add;
                 DBGPrint (5, ("          + %d    (%d - %d)*%d\n",
                               add,
                               div_ceil (prev_fiq + ts->tasks[j].J, ts->tasks[j].T),
                               1 + div_floor (start_time + ts->tasks[j].J, ts->tasks[j].T),
-                              ts->tasks[j].C));
+                              wcet (ts, j)));
             }
         }
         DBGPrint (5, ("          = %d\n", fiq));
     }
-    while (fiq != prev_fiq && fiq < max_resp);
+    while (fiq != prev_fiq && fiq < limit);
 
-    if (fiq < max_resp) {
+    if (fiq < limit) {
         return fiq;
     }
     else {
@@ -244,6 +282,11 @@ static time_value find_finish_time (struct task_set* ts, int i, int q)
     }
 }
 
+static time_value find_finish_time (struct task_set* ts, int i, int q, time_value limit)
+{
+    return finish_after_start (ts, i, q, find_start_time (ts, i, q, limit), limit);
+}
+
 static time_value analysis7_response_time (struct task_set* ts,
         int i,
         time_value initial_guess)
@@ -269,7 +312,13 @@ static time_value analysis7_response_time (struct task_set* ts,
 
         DBGPrint (3, ("    q = %d\n", q));
 
-        finish_time = find_finish_time (ts, i, q);
+        if (deadline_bounded) {
+            time_value limit = q*ts->tasks[i].T + ts->tasks[i].D - ts->tasks[i].J + 1;
+            finish_time = find_finish_time (ts, i, q, (limit < max_resp) ? limit : max_resp);
+        }
+        else {
+            finish_time = find_finish_time (ts, i, q, max_resp);
+        }
         ri = finish_time + ts->tasks[i].J - (q*ts->tasks[i].T);
 
         DBGPrint (4, ("      ri(%d) = %d - %d*%d = %d\n",
@@ -278,6 +327,9 @@ static time_value analysis7_response_time (struct task_set* ts,
         if (ri > max_ri) {
             max_ri = ri;
         }
+        if (deadline_bounded && max_ri > ts->tasks[i].D) {
+            return max_resp;
+        }
     }
 
     DBGPrint (3, ("    max ri was %d\n", max_ri));
@@ -290,12 +342,129 @@ static time_value analysis7_response_time (struct task_set* ts,
     }
 }
 
+/*
+ * the busy period, blocking and start times don't depend on task i's
+ * own threshold, so a threshold search can work them out once
+ */
+struct thresh_sweep {
+    int Q;
+    time_value* start;
+};
+
+static void* analysis7_thresh_sweep_start (struct task_set* ts, int i)
+{
+    struct thresh_sweep* sw = (struct thresh_sweep*) xmalloc (sizeof (struct thresh_sweep));
+    int q;
+
+    sw->Q = findQ (ts, i);
+    sw->start = NULL;
+    if (sw->Q == max_resp) return sw;
+
+    sw->start = (time_value*) xmalloc ((sw->Q + 1) * sizeof (time_value));
+    for (q=0; q<=sw->Q; q++) {
+        sw->start[q] = find_start_time (ts, i, q, max_resp);
+    }
+
+    return sw;
+}
+
+static time_value analysis7_thresh_sweep_response_time (struct task_set* ts,
+        int i,
+        void* p)
+{
+    struct thresh_sweep* sw = (struct thresh_sweep*) p;
+    time_value ri, max_ri;
+    int q;
+
+    if (sw->Q == max_resp) return max_resp;
+
+    max_ri = 0;
+    for (q=0; q<=sw->Q; q++) {
+        ri = finish_after_start (ts, i, q, sw->start[q], max_resp) +
+             ts->tasks[i].J - (q*ts->tasks[i].T);
+        if (ri > max_ri) {
+            max_ri = ri;
+        }
+    }
+
+    if (max_ri < max_resp) {
+        return max_ri;
+    }
+    else {
+        return max_resp;
+    }
+}
+
+static void analysis7_thresh_sweep_end (void* p)
+{
+    struct thresh_sweep* sw = (struct thresh_sweep*) p;
+
+    if (sw->start) xfree (sw->start);
+    xfree (sw);
+}
+
+#ifdef USE_DVS
+time_value ee_fppt_response_time_at (struct task_set* ts, int i, int t, freq_level f)
+{
+    time_value r;
+
+    assert (ts);
+    assert (ts->Analysis.response_time == analysis7_response_time);
+    assert (t >= 0 && t < ts->num_tasks);
+    assert (f >= MIN_FREQ_LEVEL && f < ts->profile->num_levels);
+
+    what_if_task = t;
+    what_if_level = f;
+    r = analysis7_response_time (ts, i, 0);
+    what_if_task = -1;
+
+    return r;
+}
+
+/*
+ * feasible (ts, FALSE) == num_tasks (ts) with task t at level f, but
+ * without recording response times
+ */
+int ee_fppt_feasible_at (struct task_set* ts, int t, freq_level f)
+{
+    int i;
+    int feas = TRUE;
+    double U;
+
+    assert (ts);
+    assert (ts->Analysis.valid (ts));
+    assert (ts->Analysis.response_time == analysis7_response_time);
+    assert (t >= 0 && t < ts->num_tasks);
+    assert (f >= MIN_FREQ_LEVEL && f < ts->profile->num_levels);
+
+    what_if_task = t;
+    what_if_level = f;
+    deadline_bounded = TRUE;
+
+    for (i=0, U=0; i<ts->num_tasks; i++) {
+        U += (double)wcet (ts, i) / (double)ts->tasks[i].T;
+    }
+    feas = (U <= 1.0);
+
+    for (i=0; i<ts->num_tasks && feas; i++) {
+        feas = (analysis7_response_time (ts, i, 0) <= ts->tasks[i].D);
+    }
+    what_if_task = -1;
+    deadline_bounded = FALSE;
+
+    return feas;
+}
+#endif
+
 int get_analysis7_ptrs (const char* id,
                         struct spak_analysis* A)
 {
     if (strcmp (id, "ee_fppt") == 0) {
         A->valid = analysis7_valid;
         A->response_time = analysis7_response_time;
+        A->thresh_sweep_start = analysis7_thresh_sweep_start;
+        A->thresh_sweep_response_time = analysis7_thresh_sweep_response_time;
+        A->thresh_sweep_end = analysis7_thresh_sweep_end;
         return TRUE;
     }
     else {
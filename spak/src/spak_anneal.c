@@ -0,0 +1,351 @@
+/*
+ * Copyright (c) 2002 University of Utah and the Flux Group.
+ * All rights reserved.
+ *
+ * This file is part of SPAK.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation is hereby granted without fee, provided that the
+ * above copyright notice and this permission/disclaimer notice is
+ * retained in all copies or modified versions, and that both notices
+ * appear in supporting documentation.  THE COPYRIGHT HOLDERS PROVIDE
+ * THIS SOFTWARE "AS IS" AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE COPYRIGHT
+ * HOLDERS DISCLAIM ANY LIABILITY OF ANY KIND FOR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Users are requested, but not required, to send to csl-dist@cs.utah.edu
+ * any improvements that they make and grant redistribution rights to the
+ * University of Utah.
+ *
+ * Author: John Regehr (regehr@cs.utah.edu)
+ */
+
+/*
+ * Running several annealing chains at once: independent restarts, and
+ * parallel tempering (Swendsen and Wang 86; Hukushima and Nemoto 96),
+ * where replicas at a ladder of temperatures anneal side by side and
+ * periodically trade places so that a replica stuck in a local minimum
+ * can be heated back out of it.
+ *
+ * Every replica draws from its own random stream, and the replicas
+ * only interact between rounds, so the outcome depends on the caller's
+ * random state but not on how the threads happen to be scheduled.
+ */
+
+#include "spak_public.h"
+#include "spak_internal.h"
+#include <math.h>
+#include <pthread.h>
+
+#define DBG_LEVEL 0
+
+int ANNEAL_REPLICAS = 1;
+int ANNEAL_TEMPERING = TRUE;
+int ANNEAL_EXCHANGE = 100;
+double ANNEAL_HOT = 0.1;
+double ANNEAL_COLD = 0.001;
+
+/*
+ * n streams for n chains, keyed by a seed drawn from the caller's
+ * generator
+ */
+void init_anneal_streams (struct spak_rng *rngs, int n)
+{
+  uint64_t seed;
+  int i;
+
+  seed = ((uint64_t) rand_long() << 31) ^ (uint64_t) rand_long();
+  for (i=0; i<n; i++) {
+    spak_rng_init (&rngs[i], seed, i);
+  }
+}
+
+struct anneal_thread {
+  void *(*fn) (void *);
+  void *arg;
+  struct spak_rng *rng;
+  pthread_t thread;
+};
+
+static void *anneal_thread_main (void *arg)
+{
+  struct anneal_thread *t = (struct anneal_thread *) arg;
+  struct spak_rng *old = NULL;
+
+  if (t->rng) old = spak_rng_select (t->rng);
+  t->fn (t->arg);
+  if (t->rng) spak_rng_select (old);
+  return NULL;
+}
+
+/*
+ * call fn on each of the n elements of args, each in its own thread
+ * drawing from rngs[i], and wait for them all; rngs may be NULL when fn
+ * draws no random numbers
+ */
+void run_on_threads (int n,
+		     void *(*fn) (void *),
+		     void *args,
+		     size_t size,
+		     struct spak_rng *rngs)
+{
+  struct anneal_thread *threads;
+  int i;
+
+  assert (n > 0);
+
+  threads = (struct anneal_thread *) xmalloc (n * sizeof (struct anneal_thread));
+  for (i=0; i<n; i++) {
+    threads[i].fn = fn;
+    threads[i].arg = (char *) args + i * size;
+    threads[i].rng = rngs ? &rngs[i] : NULL;
+  }
+
+  for (i=1; i<n; i++) {
+    int res = pthread_create (&threads[i].thread, NULL,
+			      anneal_thread_main, &threads[i]);
+    assert (res == 0);
+  }
+  anneal_thread_main (&threads[0]);
+  for (i=1; i<n; i++) {
+    pthread_join (threads[i].thread, NULL);
+  }
+
+  xfree (threads);
+}
+
+struct replica {
+  const struct search *s;
+  struct task_set *ts;
+  void *state;
+  double cost;            // of ts as it stands
+  double temp;            // of the rung it is on
+  int steps;              // moves left in this round
+  double best_cost;
+  struct task_set *best;
+};
+
+/*
+ * one round of Metropolis moves for one replica
+ */
+static void *run_replica (void *arg)
+{
+  struct replica *r = (struct replica *) arg;
+  const struct search_objective *obj = r->s->obj;
+  const struct search_neighbourhood *nb = r->s->moves;
+
+  for (; r->steps > 0 && r->best_cost > obj->goal; r->steps--) {
+    double c;
+
+    nb->move (r->ts, nb->arg);
+    c = obj->cost (r->ts, r->state, HUGE_VAL);
+
+    if (c <= r->cost ||
+	rand_double() < exp ((r->cost - c) / r->temp)) {
+      keep_changes (r->ts);
+      if (obj->settle) obj->settle (r->state, TRUE);
+      r->cost = c;
+      if (c < r->best_cost) {
+	r->best_cost = c;
+	free_task_set (r->best);
+	r->best = copy_task_set (r->ts);
+      }
+    } else {
+      undo_changes (r->ts);
+      if (obj->settle) obj->settle (r->state, FALSE);
+    }
+  }
+
+  return NULL;
+}
+
+/*
+ * Parallel tempering over ANNEAL_REPLICAS copies of ts.  Rung k of the
+ * ladder runs at ANNEAL_COLD * (ANNEAL_HOT/ANNEAL_COLD)^(k/(n-1)) times
+ * the cost of ts, so that one setting suits costs of any size.  After
+ * every ANNEAL_EXCHANGE moves, neighbouring rungs (alternately the even
+ * and the odd pairs) swap replicas with the usual probability
+ * min(1, exp((E_a - E_b)(1/T_a - 1/T_b))).  The
+ * search stops when some replica reaches the objective's goal, or
+ * s->patience moves after the best cost last improved; s->strategy is
+ * not used.  Returns a copy of the best assignment any replica saw; ts
+ * itself is not changed.
+ */
+struct task_set *anneal_tempering (struct task_set *ts,
+				   const struct search *s,
+				   double *best_cost)
+{
+  const struct search_objective *obj = s->obj;
+  int n = ANNEAL_REPLICAS;
+  struct replica *reps;
+  struct spak_rng *rngs;
+  struct task_set *result;
+  int *rung;
+  int i, k, b, parity;
+  int iter, last_improvement;
+  double best, scale;
+
+  assert (ts);
+  assert (obj && s->moves);
+  assert (n > 1);
+  assert (s->patience > 0);
+  assert (ANNEAL_EXCHANGE > 0);
+  assert (ANNEAL_HOT >= ANNEAL_COLD && ANNEAL_COLD > 0);
+
+  reps = (struct replica *) xmalloc (n * sizeof (struct replica));
+  rung = (int *) xmalloc (n * sizeof (int));
+  // one more stream for the exchanges
+  rngs = (struct spak_rng *) xmalloc ((n+1) * sizeof (struct spak_rng));
+  init_anneal_streams (rngs, n+1);
+
+  for (k=0; k<n; k++) {
+    struct replica *r = &reps[k];
+    r->s = s;
+    r->ts = copy_task_set (ts);
+    start_undo_log (r->ts);
+    r->state = obj->start (r->ts, obj->arg, &r->cost);
+    keep_changes (r->ts);
+    r->best_cost = r->cost;
+    r->best = copy_task_set (r->ts);
+    rung[k] = k;
+  }
+
+  scale = fabs (reps[0].cost);
+  if (scale == 0 || scale == HUGE_VAL) scale = 1;
+  for (k=0; k<n; k++) {
+    reps[k].temp = scale * ANNEAL_COLD *
+      pow (ANNEAL_HOT / ANNEAL_COLD, k / (double)(n-1));
+  }
+
+  b = 0;
+  best = reps[0].best_cost;
+  iter = last_improvement = 0;
+  parity = 0;
+
+  while (iter < last_improvement + s->patience && best > obj->goal) {
+
+    for (k=0; k<n; k++) {
+      reps[k].steps = ANNEAL_EXCHANGE;
+    }
+    run_on_threads (n, run_replica, reps, sizeof (struct replica), rngs);
+    iter += ANNEAL_EXCHANGE;
+
+    for (k=0; k<n; k++) {
+      if (reps[k].best_cost < best) {
+	best = reps[k].best_cost;
+	b = k;
+	last_improvement = iter;
+      }
+    }
+
+    for (k=parity; k+1<n; k+=2) {
+      struct replica *lo = &reps[rung[k]];
+      struct replica *hi = &reps[rung[k+1]];
+      double d = (lo->cost - hi->cost) * (1/lo->temp - 1/hi->temp);
+
+      if (d >= 0 || spak_rng_double (&rngs[n]) < exp (d)) {
+	double tmp = lo->temp;
+	int t = rung[k];
+	lo->temp = hi->temp;
+	hi->temp = tmp;
+	rung[k] = rung[k+1];
+	rung[k+1] = t;
+      }
+    }
+    parity ^= 1;
+
+    DBGPrint (2, ("anneal_tempering: %d moves per replica, best %f (replica %d)\n",
+		  iter, best, b));
+  }
+
+  result = reps[b].best;
+  reps[b].best = NULL;
+  for (i=0; i<n; i++) {
+    if (obj->finish) obj->finish (reps[i].state, obj->arg);
+    if (reps[i].best) free_task_set (reps[i].best);
+    free_task_set (reps[i].ts);
+  }
+
+  xfree (reps);
+  xfree (rung);
+  xfree (rngs);
+
+  if (best_cost) *best_cost = best;
+  return result;
+}
+
+struct restart {
+  const struct search *s;
+  struct task_set *ts;
+  void *state;
+  double cost;
+};
+
+static void *run_restart (void *arg)
+{
+  struct restart *r = (struct restart *) arg;
+
+  r->cost = local_search_unfinished (r->ts, r->s, &r->state);
+  return NULL;
+}
+
+/*
+ * Run search s from *ts the way ANNEAL_REPLICAS and ANNEAL_TEMPERING
+ * ask: as one local search in place, as parallel tempering, or as
+ * independent searches from copies of *ts, the cheapest of which wins
+ * (the first, on a tie).  In the last two cases *ts is freed and
+ * replaced by the winner.  Returns the cost of the assignment left in
+ * *ts.
+ */
+double search_with_replicas (struct task_set **ts, const struct search *s)
+{
+  int n = ANNEAL_REPLICAS;
+  struct restart *runs;
+  struct spak_rng *rngs;
+  double cost;
+  int k, b;
+
+  if (n <= 1) {
+    return local_search (*ts, s);
+  }
+
+  if (ANNEAL_TEMPERING) {
+    struct task_set *best = anneal_tempering (*ts, s, &cost);
+    free_task_set (*ts);
+    *ts = best;
+    return cost;
+  }
+
+  runs = (struct restart *) xmalloc (n * sizeof (struct restart));
+  rngs = (struct spak_rng *) xmalloc (n * sizeof (struct spak_rng));
+  init_anneal_streams (rngs, n);
+  for (k=0; k<n; k++) {
+    runs[k].s = s;
+    runs[k].ts = copy_task_set (*ts);
+  }
+  run_on_threads (n, run_restart, runs, sizeof (struct restart), rngs);
+
+  // the objective's records may be shared, so finish on this thread
+  if (s->obj->finish) {
+    for (k=0; k<n; k++) {
+      s->obj->finish (runs[k].state, s->obj->arg);
+    }
+  }
+
+  b = 0;
+  for (k=1; k<n; k++) {
+    if (runs[k].cost < runs[b].cost) b = k;
+  }
+  free_task_set (*ts);
+  *ts = runs[b].ts;
+  cost = runs[b].cost;
+  for (k=0; k<n; k++) {
+    if (k != b) free_task_set (runs[k].ts);
+  }
+  xfree (runs);
+  xfree (rngs);
+
+  return cost;
+}
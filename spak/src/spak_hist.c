@@ -0,0 +1,140 @@
+/*
+ * Copyright (c) 2002 University of Utah and the Flux Group.
+ * All rights reserved.
+ *
+ * This file is part of SPAK.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation is hereby granted without fee, provided that the
+ * above copyright notice and this permission/disclaimer notice is
+ * retained in all copies or modified versions, and that both notices
+ * appear in supporting documentation.  THE COPYRIGHT HOLDERS PROVIDE
+ * THIS SOFTWARE "AS IS" AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE COPYRIGHT
+ * HOLDERS DISCLAIM ANY LIABILITY OF ANY KIND FOR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Users are requested, but not required, to send to csl-dist@cs.utah.edu
+ * any improvements that they make and grant redistribution rights to the
+ * University of Utah.
+ *
+ * Author: John Regehr (regehr@cs.utah.edu)
+ */
+
+/*
+ * histograms of simulated response times; memory use is fixed and
+ * recording a value is a handful of instructions
+ */
+
+#include "spak_public.h"
+#include "spak_internal.h"
+
+static inline int msb (unsigned int v)
+{
+  int b = 0;
+  while (v >>= 1) b++;
+  return b;
+}
+
+static inline int bucket_index (time_value v)
+{
+  int shift;
+
+  if (v < HIST_SUB_COUNT) return v;
+
+  shift = msb (v) - HIST_SUB_BITS;
+  return HIST_SUB_COUNT * (shift + 1) + ((v >> shift) - HIST_SUB_COUNT);
+}
+
+/*
+ * largest value that falls into bucket i
+ */
+static inline time_value bucket_value (int i)
+{
+  int shift, sub;
+
+  if (i < HIST_SUB_COUNT) return i;
+
+  shift = i / HIST_SUB_COUNT - 1;
+  sub = i % HIST_SUB_COUNT + HIST_SUB_COUNT;
+  return (time_value)((((long long)sub + 1) << shift) - 1);
+}
+
+void hist_reset (struct spak_hist *h)
+{
+  assert (h);
+  memset (h, 0, sizeof (struct spak_hist));
+}
+
+void hist_record (struct spak_hist *h, time_value v)
+{
+  assert (h);
+  assert (v >= 0);
+
+  if (h->count == 0 || v < h->min) h->min = v;
+  if (h->count == 0 || v > h->max) h->max = v;
+  h->count++;
+  h->sum += v;
+  h->buckets[bucket_index (v)]++;
+}
+
+/*
+ * smallest recorded value (to within the bucket resolution) such that
+ * pct percent of the recorded values are no larger
+ */
+time_value hist_percentile (struct spak_hist *h, double pct)
+{
+  double want;
+  int i, seen;
+
+  assert (h);
+  assert (pct >= 0.0 && pct <= 100.0);
+
+  if (h->count == 0) return 0;
+
+  want = ceil (pct / 100.0 * h->count);
+  if (want < 1) want = 1;
+
+  seen = 0;
+  for (i=0; i<HIST_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= want) {
+      time_value v = bucket_value (i);
+      if (v > h->max) v = h->max;
+      if (v < h->min) v = h->min;
+      return v;
+    }
+  }
+
+  return h->max;
+}
+
+double hist_mean (struct spak_hist *h)
+{
+  assert (h);
+  if (h->count == 0) return 0.0;
+  return h->sum / h->count;
+}
+
+/*
+ * add reps copies of whatever was recorded between snapshots prev and
+ * now; the extremes are unchanged by repeating values already seen
+ */
+void hist_add_delta (struct spak_hist *h,
+                     struct spak_hist *now,
+                     struct spak_hist *prev,
+                     int reps)
+{
+  int i;
+
+  assert (h && now && prev);
+
+  if (now->count == prev->count) return;
+
+  for (i=0; i<HIST_BUCKETS; i++) {
+    h->buckets[i] += reps * (now->buckets[i] - prev->buckets[i]);
+  }
+  h->count += reps * (now->count - prev->count);
+  h->sum += reps * (now->sum - prev->sum);
+}
@@ -0,0 +1,33 @@
+/*
+ * SPAK internal header file --- not for client use
+ */
+#ifndef __SPAK_HIST_H__
+#define __SPAK_HIST_H__
+
+/*
+ * fixed-size log-bucketed histogram of non-negative times: values
+ * below 2^HIST_SUB_BITS are counted exactly, larger values fall into
+ * one of 2^HIST_SUB_BITS sub-buckets per power of two, so a reported
+ * value is never more than about 3% above the true one
+ */
+#define HIST_SUB_BITS 5
+#define HIST_SUB_COUNT (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS (HIST_SUB_COUNT * (32 - HIST_SUB_BITS))
+
+struct spak_hist {
+  int count;
+  time_value min;
+  time_value max;
+  double sum;
+  int buckets[HIST_BUCKETS];
+};
+
+extern void hist_reset (struct spak_hist *h);
+extern void hist_record (struct spak_hist *h, time_value v);
+extern time_value hist_percentile (struct spak_hist *h, double pct);
+extern double hist_mean (struct spak_hist *h);
+extern void hist_add_delta (struct spak_hist *h,
+                            struct spak_hist *now,
+                            struct spak_hist *prev,
+                            int reps);
+#endif
@@ -8,4 +8,5 @@
 #include "spak_tasks.h"
 #include "spak_pri_q.h"
 #include "spak_power.h"
+#include "spak_hist.h"
 #endif
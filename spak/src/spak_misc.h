@@ -40,7 +40,12 @@ static inline void *xmalloc (size_t size)
     assert (0);
   }
 #ifdef XMALLOC_CNT
+#ifdef __GNUC__
+  // parallel annealing allocates from several threads
+  __sync_fetch_and_add (&xmalloc_cnt, 1);
+#else
   xmalloc_cnt++;
+#endif
 #endif
   return p;
 }
@@ -48,7 +53,11 @@ static inline void *xmalloc (size_t size)
 static inline void xfree (void *p)
 {
 #ifdef XMALLOC_CNT
+#ifdef __GNUC__
+  __sync_fetch_and_sub (&xmalloc_cnt, 1);
+#else
   xmalloc_cnt--;
+#endif
 #endif
   free (p);
 }
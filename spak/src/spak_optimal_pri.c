@@ -24,17 +24,47 @@
 
 #include "spak_public.h"
 #include "spak_internal.h"
+#include <math.h>
 
 #define DBG_LEVEL 1
 
 /*
- * optimal priority assignment from Audsley 91
+ * Both searches below fill priority levels from the lowest upward.  A
+ * task's response time depends on which tasks are above it but not on
+ * their order, so the tasks still waiting for a level can hold levels
+ * 0..k in any order while level k is filled, and trying a candidate
+ * only means trading places with the task at level k.  Blocking under
+ * PCP follows the same pattern: a semaphore's ceiling reaches the
+ * candidate exactly when some task still waiting for a level uses it,
+ * and the longest lock held on it by a task below is known, so the
+ * candidate's blocking is one pass over the semaphores.
  */
-int assign_optimal_pri (struct task_set *ts)
+struct levels {
+  struct task_set *ts;
+  int preemptible;
+  int free;           // levels 0..free are not yet settled
+  int *at;            // at[k] is the task at level k
+  int *users;         // locks on each semaphore by unsettled tasks
+  time_value *held;   // longest lock on each semaphore below free
+};
+
+static void set_level (struct levels *l, int t, int k)
+{
+  struct task *task = &l->ts->tasks[t];
+
+  save_task_pri (l->ts, t);
+  task->P = k;
+  if (l->preemptible) task->PT = k;
+  l->at[k] = t;
+}
+
+/*
+ * every level is free to start with, and the initial ordering is
+ * arbitrary
+ */
+static void init_levels (struct levels *l, struct task_set *ts)
 {
-  int j, ordered, preemptible, good;
-  
-  // print_task_set (ts);
+  int i;
 
   assert (ts);
   assert (ts->Analysis.valid (ts));
@@ -45,72 +75,275 @@ int assign_optimal_pri (struct task_set *ts)
    */
   assert (is_all_preemptible (ts) || is_all_nonpreemptible (ts));
 
-  if (is_all_preemptible (ts)) {
-    preemptible = TRUE;
-  } else {
-    preemptible = FALSE;
+  l->ts = ts;
+  l->preemptible = is_all_preemptible (ts);
+  l->free = ts->num_tasks - 1;
+
+  l->at = (int *) xmalloc (ts->num_tasks * sizeof (int));
+  for (i=0; i<ts->num_tasks; i++) {
+    set_level (l, i, i);
   }
 
-  DBGPrint (5, ("assign_optimal_pri (%s):\n",
-		(preemptible)?"preemptible":"non-preemptible"));
+  l->users = (int *) xmalloc ((ts->num_sems + 1) * sizeof (int));
+  l->held = (time_value *) xmalloc ((ts->num_sems + 1) * sizeof (time_value));
+  for (i=0; i<ts->num_sems; i++) {
+    l->users[i] = 0;
+    l->held[i] = 0;
+  }
+  for (i=0; i<ts->num_locks; i++) {
+    l->users[ts->locks[i].sem - ts->sems]++;
+  }
+}
+
+static void free_levels (struct levels *l)
+{
+  xfree (l->at);
+  xfree (l->users);
+  xfree (l->held);
+}
+
+/*
+ * move task t to the lowest free level, keeping the other unsettled
+ * tasks above it
+ */
+static void try_level (struct levels *l, int t)
+{
+  int k = l->ts->tasks[t].P;
+
+  set_level (l, l->at[l->free], k);
+  set_level (l, t, l->free);
+}
 
-  // initial ordering is arbitrary
-  for (j=0; j<ts->num_tasks; j++) {
-    ts->tasks[j].P = j;
+static time_value blocking_at_level (struct levels *l, int t)
+{
+  struct task_set *ts = l->ts;
+  time_value B = 0;
+  int i;
+
+  for (i=0; i<ts->num_sems; i++) {
+    if (l->users[i] > 0 && l->held[i] > B) {
+      B = l->held[i];
+    }
   }
 
-  ordered = ts->num_tasks - 1;
-  
+  ts->tasks[t].B = B;
+  return B;
+}
+
+/*
+ * the task at the lowest free level stays there
+ */
+static void settle_level (struct levels *l)
+{
+  struct task_set *ts = l->ts;
+  struct task *task = &ts->tasks[l->at[l->free]];
+  int i;
+
+  for (i=0; i<ts->num_locks; i++) {
+    if (ts->locks[i].task == task) {
+      int s = ts->locks[i].sem - ts->sems;
+      l->users[s]--;
+      if (ts->locks[i].lock_time > l->held[s]) {
+	l->held[s] = ts->locks[i].lock_time;
+      }
+    }
+  }
+
+  l->free--;
+}
+
+/*
+ * put the unsettled tasks back in index order, as a failed search
+ * always left them
+ */
+static void sort_free_levels (struct levels *l)
+{
+  int i, k = 0;
+
+  for (i=0; i<l->ts->num_tasks; i++) {
+    if (l->ts->tasks[i].P <= l->free) {
+      set_level (l, i, k++);
+    }
+  }
+}
+
+/*
+ * optimal priority assignment from Audsley 91
+ */
+int assign_optimal_pri (struct task_set *ts)
+{
+  struct levels l;
+  int j, good;
+
+  init_levels (&l, ts);
+
+  DBGPrint (5, ("assign_optimal_pri (%s):\n",
+		(l.preemptible)?"preemptible":"non-preemptible"));
+
   do {
 
     good = FALSE;
 
-    for (j=0; j<ts->num_tasks; j++) {
+    for (j=0; j<ts->num_tasks && l.free >= 0; j++) {
       time_value rj;
-
       int Pj = ts->tasks[j].P;
 
-      if (Pj > ordered) continue;
-
-      if (!barriers_permit_pri (ts, j, ordered)) continue;
+      if (Pj > l.free) continue;
 
-      assign_pri (ts, j, ordered);
-
-      /*
-       * this is an inefficient way to keep preemption thresholds
-       * synchronized with priorities...
-       */
-      if (preemptible) {
-    	make_all_preemptible (ts);
-      } else {
-	    make_all_nonpreemptible (ts);
-      }
+      if (!barriers_permit_pri (ts, j, l.free)) continue;
 
-      calculate_blocking_pcp (ts);
+      try_level (&l, j);
+      blocking_at_level (&l, j);
 
       rj = ts->Analysis.response_time (ts, j, ts->tasks[j].C); 
       DBGPrint (5, ("  task %d: r = %d, D = %d\n",
 		    j, rj, ts->tasks[j].D));
       if (rj <= ts->tasks[j].D) {
-		// schedulable
-		DBGPrint (5, ("  task %d is schedulable at pri %d\n",
-				  j, ordered));
-		ordered--;
-		good = TRUE;
+	// schedulable, and the tasks above it won't change that
+	DBGPrint (5, ("  task %d is schedulable at pri %d\n",
+		      j, l.free));
+	ts->tasks[j].R = rj;
+	ts->tasks[j].S = 1;
+	settle_level (&l);
+	good = TRUE;
       } else {
-		DBGPrint (5, ("  task %d not schedulable at pri %d\n",
-				  j, ordered));
-		// not schedulable
-		assign_pri (ts, j, Pj);
+	DBGPrint (5, ("  task %d not schedulable at pri %d\n",
+		      j, l.free));
       }
     }
 
-  } while (ordered >= 0 && good);
+  } while (l.free >= 0 && good);
+
+  sort_free_levels (&l);
+  free_levels (&l);
+  calculate_blocking_pcp (ts);
 
   DBGPrint (5, ("  assign_optimal_pri returning %s\n",
 		(good)?"success":"failure"));
 
-  if (good) assert (feasible (ts, TRUE) == ts->num_tasks);
-
   return good;
 }
+
+#define THRESH 0.00001
+
+static int fits_scaled (struct levels *l, int t,
+			time_value *Corig,
+			double scale)
+{
+  struct task_set *ts = l->ts;
+  int i;
+
+  for (i=0; i<ts->num_tasks; i++) {
+    ts->tasks[i].C = (time_value) (Corig[i] * scale);
+  }
+
+  return feasible_one_task (ts, t);
+}
+
+/*
+ * the largest factor by which every C can grow with task t still
+ * meeting its deadline at the lowest free level, found by bisection as
+ * in find_critical_scale()
+ */
+static double tolerance_at_level (struct levels *l, int t,
+				  time_value *Corig)
+{
+  double low, high;
+
+  blocking_at_level (l, t);
+
+  low = high = 1.0;
+  if (fits_scaled (l, t, Corig, 1.0)) {
+    do {
+      low = high;
+      high *= 10.0;
+    } while (fits_scaled (l, t, Corig, high));
+  } else {
+    do {
+      high = low;
+      low *= 0.1;
+      // blocking or release jitter alone can miss the deadline
+      if (low < THRESH) return 0;
+    } while (!fits_scaled (l, t, Corig, low));
+  }
+
+  while ((high - low) > THRESH) {
+    double middle = (low + high) / 2;
+
+    if (fits_scaled (l, t, Corig, middle)) {
+      low = middle;
+    } else {
+      high = middle;
+    }
+  }
+
+  return low;
+}
+
+/*
+ * robust priority assignment (Davis and Burns 07): level by level from
+ * the lowest, place the task that tolerates the largest growth in
+ * execution times there.  The ordering maximizes the critical scaling
+ * factor, which is returned through tolerance; the result says whether
+ * the task set is schedulable as it stands.
+ */
+int assign_robust_pri (struct task_set *ts, double *tolerance)
+{
+  struct levels l;
+  time_value *Corig;
+  double worst = HUGE_VAL;
+  int i, j;
+
+  init_levels (&l, ts);
+
+  Corig = (time_value *) xmalloc (ts->num_tasks * sizeof (time_value));
+  for (i=0; i<ts->num_tasks; i++) {
+    Corig[i] = ts->tasks[i].C;
+  }
+
+  while (l.free >= 0) {
+    int best = -1;
+    double best_tol = -1;
+
+    for (j=0; j<ts->num_tasks; j++) {
+      double tol;
+
+      if (ts->tasks[j].P > l.free) continue;
+
+      if (!barriers_permit_pri (ts, j, l.free)) continue;
+
+      try_level (&l, j);
+      tol = tolerance_at_level (&l, j, Corig);
+      DBGPrint (5, ("  task %d tolerates %f at pri %d\n", j, tol, l.free));
+      if (tol > best_tol) {
+	best = j;
+	best_tol = tol;
+      }
+    }
+
+    // the barriers leave nobody for this level
+    if (best == -1) {
+      worst = 0;
+      break;
+    }
+
+    try_level (&l, best);
+    blocking_at_level (&l, best);
+    settle_level (&l);
+    if (best_tol < worst) worst = best_tol;
+  }
+
+  for (i=0; i<ts->num_tasks; i++) {
+    ts->tasks[i].C = Corig[i];
+  }
+  xfree (Corig);
+
+  sort_free_levels (&l);
+  free_levels (&l);
+  calculate_blocking_pcp (ts);
+
+  DBGPrint (5, ("  assign_robust_pri: tolerance %f\n", worst));
+
+  if (tolerance) *tolerance = worst;
+  return worst >= 1.0 && feasible (ts, TRUE) == ts->num_tasks;
+}
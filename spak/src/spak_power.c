@@ -27,10 +27,376 @@
 
 #define DBG_LEVEL 3
 
-static energy_value calculate_tast_engergy(struct task* t){
-	assert(t);
+/*
+ * the classic idealized processor: six levels, power proportional to
+ * f^3 and no static power; idling costs as much as running at the
+ * slowest level
+ */
+#define CUBE(f) ((f)*(f)*(f))
+
+static const struct dvfs_profile default_profile = {
+	"default",
+	6,
+	{
+		{0.1, 0.0, CUBE(0.1), 0.0},
+		{0.3, 0.0, CUBE(0.3), 0.0},
+		{0.5, 0.0, CUBE(0.5), 0.0},
+		{0.7, 0.0, CUBE(0.7), 0.0},
+		{0.9, 0.0, CUBE(0.9), 0.0},
+		{1.0, 0.0, CUBE(1.0), 0.0},
+	},
+	CUBE(0.1),
+	CUBE(0.1),
+};
+
+const struct dvfs_profile* default_dvfs_profile (void)
+{
+	return &default_profile;
+}
+
+/*
+ * read a profile; lines are
+ *
+ *   name <name>
+ *   idle <power>
+ *   sleep <power>
+ *   level <frequency> <voltage> <dynamic power> <static power>
+ *
+ * and anything after a '#' is ignored.  Frequencies may be in any unit
+ * and levels in any order; they are sorted and scaled so that the
+ * fastest level is 1.0.  Returns NULL if the file is malformed.
+ */
+struct dvfs_profile* fload_dvfs_profile (FILE* fp)
+{
+	struct dvfs_profile* prof;
+	char line[4096];
+	int i, j;
+
+	assert (fp);
+
+	prof = (struct dvfs_profile*) xmalloc (sizeof (struct dvfs_profile));
+	memset (prof, 0, sizeof (struct dvfs_profile));
+	strncpy (prof->name, "loaded_profile", MAX_PROFILE_NAMELEN);
+
+	while (fgets (line, 4096, fp)) {
+		char key[4096];
+		char* comment = strchr (line, '#');
+		struct dvfs_level l;
+
+		if (comment) *comment = '\0';
+		if (sscanf (line, "%s", key) != 1) continue;
+
+		if (strcmp (key, "name") == 0) {
+			if (sscanf (line, "%*s %63s", prof->name) != 1) goto bad;
+		}
+		else if (strcmp (key, "idle") == 0) {
+			if (sscanf (line, "%*s %lf", &prof->idle_power) != 1) goto bad;
+		}
+		else if (strcmp (key, "sleep") == 0) {
+			if (sscanf (line, "%*s %lf", &prof->sleep_power) != 1) goto bad;
+		}
+		else if (strcmp (key, "level") == 0) {
+			if (sscanf (line, "%*s %lf %lf %lf %lf", &l.f, &l.voltage,
+			            &l.dynamic_power, &l.static_power) != 4) goto bad;
+			if (l.f <= 0 || prof->num_levels == MAX_DVFS_LEVELS) goto bad;
+			// insertion sort by frequency
+			for (i=prof->num_levels; i>0 && prof->levels[i-1].f > l.f; i--) {
+				prof->levels[i] = prof->levels[i-1];
+			}
+			prof->levels[i] = l;
+			prof->num_levels++;
+		}
+		else {
+			goto bad;
+		}
+	}
+
+	if (prof->num_levels == 0) goto bad;
+
+	for (i=0, j=prof->num_levels-1; i<j; i++) {
+		prof->levels[i].f /= prof->levels[j].f;
+	}
+	prof->levels[j].f = 1.0;
+
+	return prof;
+
+ bad:
+	xfree (prof);
+	return NULL;
+}
+
+struct dvfs_profile* load_dvfs_profile (const char* fn)
+{
+	struct dvfs_profile* prof;
+	FILE* inf;
+
+	inf = fopen (fn, "r");
+	if (!inf) return NULL;
+	prof = fload_dvfs_profile (inf);
+	fclose (inf);
+	return prof;
+}
+
+void free_dvfs_profile (struct dvfs_profile* prof)
+{
+	assert (prof);
+	assert (prof != &default_profile);
+
+	xfree (prof);
+}
+
+void fprint_dvfs_profile (const struct dvfs_profile* prof, FILE* fp)
+{
+	int i;
+
+	assert (prof);
+
+	fprintf (fp, "profile %s  idle %f  sleep %f\n",
+	         prof->name, prof->idle_power, prof->sleep_power);
+	fprintf (fp, "Level   Freq    Voltage Dynamic  Static\n");
+	for (i=0; i<prof->num_levels; i++) {
+		fprintf (fp, "%5d %0.5f %0.5f %f %f\n",
+		         i,
+		         prof->levels[i].f,
+		         prof->levels[i].voltage,
+		         prof->levels[i].dynamic_power,
+		         prof->levels[i].static_power);
+	}
+}
+
+/*
+ * power drawn while running at level f
+ */
+power_value dvfs_level_power (const struct dvfs_profile* prof, freq_level f)
+{
+	assert (prof);
+	assert (f >= MIN_FREQ_LEVEL);
+	assert (f < prof->num_levels);
+
+	return prof->levels[f].dynamic_power + prof->levels[f].static_power;
+}
+
+/*
+ * the level that does a unit of work for the least energy; with static
+ * power, running any slower than this costs more, not less
+ */
+freq_level dvfs_critical_level (const struct dvfs_profile* prof)
+{
+	freq_level f, best = MIN_FREQ_LEVEL;
+
+	assert (prof);
+
+	for (f=MIN_FREQ_LEVEL+1; f<prof->num_levels; f++) {
+		if (dvfs_level_power (prof, f) / prof->levels[f].f <
+		    dvfs_level_power (prof, best) / prof->levels[best].f) {
+			best = f;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * switch ts over to another profile; each task moves to the slowest
+ * level of prof that is at least as fast as the one it ran at
+ */
+void set_dvfs_profile (struct task_set* ts, const struct dvfs_profile* prof)
+{
+	int i;
+
+	assert (ts);
+	assert (prof);
+	assert (prof->num_levels > 0 && prof->num_levels <= MAX_DVFS_LEVELS);
+
+	for (i=0; i<ts->num_tasks; i++) {
+		freq_scale old = ts->profile->levels[ts->tasks[i].f].f;
+		freq_level f = prof->num_levels-1;
+
+		while (f > MIN_FREQ_LEVEL && prof->levels[f-1].f >= old) f--;
+		ts->tasks[i].f = f;
+	}
+
+	ts->profile = prof;
+	for (i=0; i<ts->num_tasks; i++) {
+		fill_task_level_wcets (ts, i);
+		set_wcet (ts, i, ts->tasks[i].Cf[ts->tasks[i].f]);
+	}
+}
+
+const struct dvfs_profile* get_dvfs_profile (struct task_set* ts)
+{
+	assert (ts);
+
+	return ts->profile;
+}
+
+freq_level get_max_frequency_level (struct task_set* ts)
+{
+	assert (ts);
+
+	return ts->profile->num_levels-1;
+}
+
+freq_scale get_frequency_scale (struct task_set* ts, freq_level f)
+{
+	assert (ts);
+	assert (f >= MIN_FREQ_LEVEL);
+	assert (f < ts->profile->num_levels);
+
+	return ts->profile->levels[f].f;
+}
+
+/*
+ * energy used by one job of task t running at level f
+ */
+energy_value get_task_job_energy (struct task_set* ts, int t, freq_level f)
+{
+	assert (ts);
+	assert (t < ts->num_tasks);
+
+	return (energy_value)get_task_wcet_at_level (ts, t, f) *
+		dvfs_level_power (ts->profile, f);
+}
+
+int ENERGY_CROSS_CHECK = FALSE;
+
+energy_value compute_task_energy (struct task_set* ts,
+				  int t,
+				  freq_level f,
+				  time_value horizon,
+				  const struct dvfs_profile* prof)
+{
+	long long jobs;
+	time_value C;
+
+	assert (ts);
+	assert (t >= 0 && t < ts->num_tasks);
+	assert (horizon >= 0);
+
+	if (!prof) prof = ts->profile;
+	assert (f >= MIN_FREQ_LEVEL && f < prof->num_levels);
+
+	jobs = (horizon + ts->tasks[t].T - 1) / ts->tasks[t].T;
+	C = modify_task_C_by_freq (ts->tasks[t].Cu, prof->levels[f].f);
+
+	return (energy_value)(jobs * C) * dvfs_level_power (prof, f);
+}
+
+static void cross_check_energy (struct task_set* ts,
+				time_value horizon,
+				const struct dvfs_profile* prof,
+				energy_value analytic)
+{
+	struct task_set* ts_copy = copy_task_set (ts);
+	int old_hyperperiod = SIM_HYPERPERIOD;
+	energy_value sim;
+	int i;
+
+	/*
+	 * prof is indexed by the tasks' own levels, so keep them rather
+	 * than remapping through set_dvfs_profile
+	 */
+	ts_copy->profile = prof;
+	for (i=0; i<ts_copy->num_tasks; i++) {
+		fill_task_level_wcets (ts_copy, i);
+		set_wcet (ts_copy, i, ts_copy->tasks[i].Cf[ts_copy->tasks[i].f]);
+	}
+
+	/*
+	 * the closed form charges every released job in full, which is
+	 * only what happens if the processor is idle at the horizon; that
+	 * is certain at a multiple of the hyperperiod of a feasible set
+	 * with D <= T, and other horizons are not checked
+	 */
+	for (i=0; i<ts_copy->num_tasks; i++) {
+		if (horizon % ts_copy->tasks[i].T != 0 ||
+		    ts_copy->tasks[i].D > ts_copy->tasks[i].T) break;
+	}
+	if (i < ts_copy->num_tasks || feasible (ts_copy, FALSE) != ts_copy->num_tasks) {
+		free_task_set (ts_copy);
+		return;
+	}
+
+	SIM_HYPERPERIOD = TRUE;
+	sim = simulate_energy (ts_copy, horizon);
+	SIM_HYPERPERIOD = old_hyperperiod;
+	free_task_set (ts_copy);
+
+	if (fabs (sim - analytic) > 1e-9 * (fabs (sim) + 1.0)) {
+		printf ("energy cross-check: task set %s horizon %d: analytic %f, simulated %f\n",
+			ts->name, horizon, analytic, sim);
+	}
+}
+
+energy_value compute_energy (struct task_set* ts,
+			     time_value horizon,
+			     const struct dvfs_profile* prof)
+{
+	energy_value busy_energy = 0;
+	double busy_time = 0;
+	int i;
+
+	assert (ts);
+	assert (horizon >= 0);
+
+	if (!prof) prof = ts->profile;
+
+	for (i=0; i<ts->num_tasks; i++) {
+		freq_level f = ts->tasks[i].f;
+
+		busy_energy += compute_task_energy (ts, i, f, horizon, prof);
+		busy_time += (energy_value)((horizon + ts->tasks[i].T - 1) / ts->tasks[i].T) *
+			modify_task_C_by_freq (ts->tasks[i].Cu, prof->levels[f].f);
+	}
+
+	if (busy_time < horizon) {
+		busy_energy += (horizon - busy_time) * prof->idle_power;
+	}
+
+	if (ENERGY_CROSS_CHECK) {
+		cross_check_energy (ts, horizon, prof, busy_energy);
+	}
+
+	return busy_energy;
+}
+
+/*
+ * the energy compute_energy charges over a hyperperiod, divided by its
+ * length; the hyperperiod itself is never formed, since for most sets
+ * of periods it does not fit in a time_value
+ */
+power_value compute_average_power (struct task_set* ts,
+				   const struct dvfs_profile* prof)
+{
+	power_value p = 0;
+	double U = 0;
+	int i;
+
+	assert (ts);
+
+	if (!prof) prof = ts->profile;
+
+	for (i=0; i<ts->num_tasks; i++) {
+		freq_level f = ts->tasks[i].f;
+		double u = (double)modify_task_C_by_freq (ts->tasks[i].Cu, prof->levels[f].f) /
+			(double)ts->tasks[i].T;
+
+		p += u * dvfs_level_power (prof, f);
+		U += u;
+	}
+
+	if (U < 1.0) {
+		p += (1.0 - U) * prof->idle_power;
+	}
+
+	return p;
+}
+
+static energy_value calculate_tast_engergy(struct task_set* ts, int t){
+	assert(ts);
 
-	return (energy_value)((double)(t->C) * pow(valid_f_scale[t->f], 3.0));
+	return (energy_value)((double)(ts->tasks[t].C) *
+			      dvfs_level_power (ts->profile, ts->tasks[t].f));
 }
 
 power_value calculate_tast_set_average_power(struct task_set* ts){
@@ -46,7 +412,7 @@ power_value calculate_tast_set_average_power(struct task_set* ts){
 
 	energy_value sum = 0;
 	for(i=0; i<ts->num_tasks; i++){
-		sum += calculate_tast_engergy(&ts->tasks[i]);
+		sum += calculate_tast_engergy(ts, i);
 	}
 
 	p = (power_value)(sum);
@@ -87,14 +87,36 @@ static int np_constr_wrong (struct task_set *ts, int t)
   return FALSE;
 }
 
+long mpta_rta_calls = 0;
+long mpta_rta_calls_saved = 0;
+
+/*
+ * response time of task i at threshold pt, through the analysis's
+ * threshold sweep if it has one
+ */
+static time_value thresh_response_time (struct task_set *ts, int i, 
+					int pt, void *sweep)
+{
+  ts->tasks[i].PT = pt;
+  if (sweep) {
+    return ts->Analysis.thresh_sweep_response_time (ts, i, sweep);
+  } else {
+    return ts->Analysis.response_time (ts, i, 0);
+  }
+}
+
 /*
  * this is the "assign preemption thresholds" algorithm from Figure 2
- * of Wang and Saksena 99
+ * of Wang and Saksena 99.  Raising a task's threshold can only shorten
+ * its response time, so rather than lowering the threshold a step at a
+ * time until the task meets its deadline we bisect for the lowest
+ * threshold (largest PT) that works.
  */
 int assign_optimal_preemption_thresholds (struct task_set *ts)
 {
-  int i, current, found;
-  time_value ri;
+  int i, current, found, top, lo, hi, mid, calls;
+  time_value ri, r;
+  void *sweep;
 
   assert (uses_preempt_thresh_analysis (ts));
   make_all_preemptible (ts);
@@ -110,15 +132,48 @@ int assign_optimal_preemption_thresholds (struct task_set *ts)
 	  assert (ts->tasks[i].PT >= 0);
 	}
 	respect_constraints (ts);
-	ri = ts->Analysis.response_time (ts, i, 0);
-	while (ri > ts->tasks[i].D) {
-	  ts->tasks[i].PT--;
-	  if (ts->tasks[i].PT < 0) {
-	    ts->tasks[i].PT = 0;
-	    return FALSE;
+
+	sweep = NULL;
+	if (ts->Analysis.thresh_sweep_start) {
+	  sweep = ts->Analysis.thresh_sweep_start (ts, i);
+	}
+
+	top = ts->tasks[i].PT;
+	ri = thresh_response_time (ts, i, top, sweep);
+	calls = 1;
+	lo = top;
+	if (ri > ts->tasks[i].D && top > 0) {
+	  ri = thresh_response_time (ts, i, 0, sweep);
+	  calls++;
+	  lo = 0;
+	}
+	if (ri > ts->tasks[i].D) {
+	  if (sweep) ts->Analysis.thresh_sweep_end (sweep);
+	  ts->tasks[i].PT = 0;
+	  __sync_fetch_and_add (&mpta_rta_calls, calls);
+	  __sync_fetch_and_add (&mpta_rta_calls_saved, top + 1 - calls);
+	  return FALSE;
+	}
+
+	// lo meets the deadline and, unless it is top, hi doesn't
+	hi = top;
+	while (hi - lo > 1) {
+	  mid = lo + (hi - lo) / 2;
+	  r = thresh_response_time (ts, i, mid, sweep);
+	  calls++;
+	  if (r > ts->tasks[i].D) {
+	    hi = mid;
+	  } else {
+	    lo = mid;
+	    ri = r;
 	  }
-	  ri = ts->Analysis.response_time (ts, i, 0);
 	}
+	ts->tasks[i].PT = lo;
+
+	if (sweep) ts->Analysis.thresh_sweep_end (sweep);
+	__sync_fetch_and_add (&mpta_rta_calls, calls);
+	__sync_fetch_and_add (&mpta_rta_calls_saved, top - lo + 1 - calls);
+
 	DBGPrint (3, ("task %d: ri = %d, dl = %d\n",
 		      i, ri, ts->tasks[i].D));
       }
@@ -638,231 +693,339 @@ int exhaustive_assign_optimal_priorities_and_thresholds (struct task_set *ts)
 }
 
 /*
- * For a given assignment of priorities and preemption thresholds,
- * return the minimum number of non-preemptible groups that the task
- * set can be divided into.
- *
- * This is from Figure 3 of Saksena and Wang 00.
+ * Thread partitions, from Figure 3 of Saksena and Wang 00.  Taking the
+ * tasks in order of non-increasing preemption threshold, each task not
+ * yet placed opens a thread at its threshold, and that thread takes
+ * every later task whose priority is no higher than the threshold.
+ * The thresholds threads open at only fall, so the thread a task joins
+ * is the first one whose threshold its priority reaches, found by
+ * bisection.  The order is a counting sort on thresholds, and when just
+ * one task's threshold changes it is moved to its new place in the
+ * order rather than the whole order being rebuilt.
  */
-int optimal_partition_into_threads (struct task_set *ts)
+static int goes_before (struct task_set *ts, int a, int b)
 {
-  int nthreads = 0;
-  int *pt_map, *scratch;
-  int k, j;
+  return ts->tasks[a].PT > ts->tasks[b].PT ||
+    (ts->tasks[a].PT == ts->tasks[b].PT && a < b);
+}
 
-  assert (ts);
-  assert (uses_preempt_thresh_analysis (ts));
-  assert (ts->Analysis.valid (ts));
+/*
+ * bring the whole order up to date
+ */
+void sort_thread_partition (struct thread_partition *tp,
+			    struct task_set *ts)
+{
+  int *start;
+  int i, k;
+  int n = tp->n;
+
+  // start[k] is the first place for tasks with threshold n-1-k
+  start = (int *) xmalloc ((n+1) * sizeof (int));
+  for (k=0; k<=n; k++) {
+    start[k] = 0;
+  }
+  for (i=0; i<n; i++) {
+    assert (ts->tasks[i].PT >= 0 && ts->tasks[i].PT < n);
+    start[n - ts->tasks[i].PT]++;
+  }
+  for (k=1; k<=n; k++) {
+    start[k] += start[k-1];
+  }
+  for (i=0; i<n; i++) {
+    k = n-1 - ts->tasks[i].PT;
+    tp->order[start[k]] = i;
+    tp->pos[i] = start[k]++;
+  }
 
-  pt_map = (int *) xmalloc (sizeof (int) * ts->num_tasks);
-  scratch = (int *) xmalloc (sizeof (int) * ts->num_tasks);
+  xfree (start);
+}
 
-  for (k=0; k<ts->num_tasks; k++) {
-    scratch[k] = FALSE;
-  }
+void init_thread_partition (struct thread_partition *tp,
+			    struct task_set *ts)
+{
+  int n = ts->num_tasks;
 
-  /*
-   * sort tasks by preemption threshold in non-decreasing order 
-   */
-  for (k=0; k<ts->num_tasks; k++) {
-    int max = -1;
-    for (j=0; j<ts->num_tasks; j++) {
-      if (!scratch[j] && (max == -1 || ts->tasks[j].PT > ts->tasks[max].PT)) {
-	max = j;
-      }
-    }
-    assert (max != -1);
-    pt_map[k] = max;
-    scratch[max] = TRUE;
-    DBGPrint (3, ("%d: task %d, p = %d, pt = %d\n",
-		  k, max, ts->tasks[max].P, ts->tasks[max].PT));
-  }
-
-  xfree (scratch);
-
-  for (k=0; k<ts->num_tasks; k++) {
-    int tk = pt_map[k];
-    if (tk == -1) continue;
-    ts->tasks[tk].thread = nthreads;
-    for (j=k+1; j<ts->num_tasks; j++) {
-      int tj = pt_map[j];
-      if (tj == -1) continue;
-      if (ts->tasks[tj].P >= ts->tasks[tk].PT) {
-	ts->tasks[tj].thread = nthreads;
-	pt_map[j] = -1;
-      }
-    }
-    nthreads++;
-  }
+  tp->n = n;
+  tp->order = (int *) xmalloc (n * sizeof (int));
+  tp->pos = (int *) xmalloc (n * sizeof (int));
+  tp->ceiling = (int *) xmalloc (n * sizeof (int));
+  sort_thread_partition (tp, ts);
+}
 
-  xfree (pt_map);
+void free_thread_partition (struct thread_partition *tp)
+{
+  xfree (tp->order);
+  xfree (tp->pos);
+  xfree (tp->ceiling);
+}
 
-  DBGPrint (4, ("these %d tasks can be run in %d threads\n",
-		num_tasks (ts), nthreads));
+/*
+ * task t's threshold, and no other, has changed since the order was
+ * last up to date
+ */
+void thread_partition_moved (struct thread_partition *tp,
+			     struct task_set *ts,
+			     int t)
+{
+  int k = tp->pos[t];
 
-  for (k=0; k<nthreads; k++) {
-    DBGPrint (4, ("thread %d: ", k));
-    for (j=0; j<ts->num_tasks; j++) {
-      if (ts->tasks[j].thread == k) {
-	DBGPrint (4, ("%d ", j));
-      }
-    }
-    DBGPrint (4, ("\n"));
+  while (k > 0 && goes_before (ts, t, tp->order[k-1])) {
+    tp->order[k] = tp->order[k-1];
+    tp->pos[tp->order[k]] = k;
+    k--;
   }
+  while (k < tp->n-1 && goes_before (ts, tp->order[k+1], t)) {
+    tp->order[k] = tp->order[k+1];
+    tp->pos[tp->order[k]] = k;
+    k++;
+  }
+  tp->order[k] = t;
+  tp->pos[t] = k;
+}
 
-  for (k=0; k<ts->num_tasks; k++) {
-    for (j=0; j<ts->num_tasks; j++) {
-      if (j != k && ts->tasks[k].thread == ts->tasks[j].thread) {
-	assert (ts->tasks[k].P >= ts->tasks[j].PT &&
-		ts->tasks[j].P >= ts->tasks[k].PT);
-      } else {
-	// FIXME
+/*
+ * set every task's thread and return the number of threads
+ */
+int partition_into_threads (struct thread_partition *tp,
+			    struct task_set *ts)
+{
+  int nthreads = 0;
+  int k, t;
+
+  for (k=0; k<tp->n; k++) {
+    int p;
+
+    t = tp->order[k];
+    p = ts->tasks[t].P;
+    if (nthreads > 0 && tp->ceiling[nthreads-1] <= p) {
+      int lo = 0, hi = nthreads-1;
+      while (lo < hi) {
+	int mid = (lo + hi) / 2;
+	if (tp->ceiling[mid] <= p) {
+	  hi = mid;
+	} else {
+	  lo = mid + 1;
+	}
       }
+      ts->tasks[t].thread = lo;
+    } else {
+      tp->ceiling[nthreads] = ts->tasks[t].PT;
+      ts->tasks[t].thread = nthreads++;
     }
+    DBGPrint (3, ("%d: task %d, p = %d, pt = %d, thread %d\n",
+		  k, t, p, ts->tasks[t].PT, ts->tasks[t].thread));
+  }
+
+  /*
+   * every task's priority and threshold straddle its thread's
+   * threshold, so no two tasks in a thread can preempt each other
+   */
+  for (t=0; t<tp->n; t++) {
+    assert (ts->tasks[t].PT <= tp->ceiling[ts->tasks[t].thread] &&
+	    tp->ceiling[ts->tasks[t].thread] <= ts->tasks[t].P);
   }
 
   return nthreads;
 }
 
-int ANNEAL_MAX = -1;
-double INIT_TEMP = 0.00;
-double TEMP_SCALE = 0.99;
-
 /*
- * Given a feasible assignment of priorities and preemption
- * thresholds, attempt to adjust priorities and thresholds in order to
- * reduce the number of threads onto which they are assigned; this has
- * the obvious side effect of increasing the sensitivity of the task
- * set.
+ * For a given assignment of priorities and preemption thresholds,
+ * return the minimum number of non-preemptible groups that the task
+ * set can be divided into.
  */
-static void anneal_threads_or_cs (struct task_set *orig_ts, 
-				  int target,
-				  int *optimized,
-				  double *best_cs_per_thr,
-				  struct task_set **best_ts_per_thr,
-				  int target_pt_support)
+int optimal_partition_into_threads (struct task_set *ts)
 {
-  int best_thr, new_thr;
-  double temp = INIT_TEMP;
-  struct task_set *new_ts, *best_ts;
-  int i;
-  int last_improvement = 0;
-  double best_cs, new_cs;
+  struct thread_partition tp;
+  int nthreads;
 
-  assert (ANNEAL_MAX != -1);
+  assert (ts);
+  assert (uses_preempt_thresh_analysis (ts));
+  assert (ts->Analysis.valid (ts));
 
-  best_thr = optimal_partition_into_threads (orig_ts);
+  init_thread_partition (&tp, ts);
+  nthreads = partition_into_threads (&tp, ts);
+  free_thread_partition (&tp);
 
-  assert (target == -1 || target == best_thr);
-  assert (feasible (orig_ts, FALSE) == orig_ts->num_tasks);
+  DBGPrint (4, ("these %d tasks can be run in %d threads\n",
+		num_tasks (ts), nthreads));
 
-  best_ts = copy_task_set (orig_ts);
-  best_cs = find_critical_scale (orig_ts, NULL);
+  return nthreads;
+}
 
-  free_task_set (orig_ts);
-  
-  if (!target_pt_support) {
-    assert (are_all_tasks_in_clusters (best_ts));
-    ensure_target_doesnt_need_pt (best_ts);
-  }
+/*
+ * The fewest threads that any feasible choice of preemption thresholds
+ * allows for the priorities in ts, by branch and bound.  Thresholds are
+ * chosen from the lowest priority level upward.  A task's response time
+ * depends on its own threshold and on those of the tasks at or below
+ * its level, never on those above, so a level that misses a deadline
+ * is dropped with everything above it.  Tasks still without a
+ * threshold sit at the highest one they may take, which can only merge
+ * threads, so partitioning the set as it stands bounds the threads any
+ * completion needs; lowering a threshold can only raise that bound, so
+ * once it reaches the incumbent the rest of a task's thresholds are
+ * skipped.  The first incumbent is what maximize_preempt_thresholds
+ * finds.
+ *
+ * Leaves ts with the thresholds and threads found and returns the
+ * number of threads, or returns 0 and leaves ts alone if no choice of
+ * thresholds is feasible.
+ */
+struct fewest_threads {
+  struct task_set *ts;
+  struct thread_partition part;
+  int *order;     // the tasks from the lowest priority up
+  int *lo, *hi;   // the thresholds each task may take
+  int *best_pt;
+  int best;       // threads with best_pt, or more than there are tasks
+  long nodes;
+};
+
+static int level_feasible (struct fewest_threads *f, int d)
+{
+  struct task_set *ts = f->ts;
+  int p = ts->tasks[f->order[d]].P;
 
-  if (best_cs > best_cs_per_thr[best_thr]) {
-    best_cs_per_thr[best_thr] = best_cs;
-    if (best_ts_per_thr[best_thr]) free_task_set (best_ts_per_thr[best_thr]);
-    best_ts_per_thr[best_thr] = copy_task_set (best_ts);
+  for (; d>=0 && ts->tasks[f->order[d]].P == p; d--) {
+    int t = f->order[d];
+    if (ts->Analysis.response_time (ts, t, 0) > ts->tasks[t].D) return FALSE;
   }
+  return TRUE;
+}
 
-  DBGPrint (1, ("minimize_threads_by_annealing: %d initial threads, target = %d\n", 
-		best_thr, target));
-
-  new_cs = 0;
-  i = 0;
-  while (i < (last_improvement + ANNEAL_MAX)) {
-
-    if (i%100 == 0) DBGPrint (2, ("anneal_threads_or_cs (%d) %d\n", target, i));
-
-    new_ts = copy_task_set (best_ts);
+static void fewest_threads_from (struct fewest_threads *f, int d)
+{
+  struct task_set *ts = f->ts;
+  int t = f->order[d];
+  int n = ts->num_tasks;
+  int pt, i, thr;
 
-    if (i != 0) {
-      if (target_pt_support) {
-	permute_pri_and_thresh (new_ts);
-	respect_constraints_randomly (new_ts);
+  for (pt=f->lo[t]; pt<=f->hi[t]; pt++) {
+    if (!barriers_permit_pri (ts, t, pt)) continue;
+    f->nodes++;
+    ts->tasks[t].PT = pt;
+    thread_partition_moved (&f->part, ts, t);
+    thr = partition_into_threads (&f->part, ts);
+    if (thr >= f->best) break;
+    if (d < n-1 && ts->tasks[f->order[d+1]].P == ts->tasks[t].P) {
+      fewest_threads_from (f, d+1);
+    } else if (level_feasible (f, d)) {
+      if (d < n-1) {
+	fewest_threads_from (f, d+1);
       } else {
-	permute_npt (new_ts);
+	f->best = thr;
+	for (i=0; i<n; i++) {
+	  f->best_pt[i] = ts->tasks[i].PT;
+	}
+	DBGPrint (3, ("  %d threads after %ld nodes\n", thr, f->nodes));
       }
-    } else {
-      assert (feasible (new_ts, FALSE) == new_ts->num_tasks);
     }
+  }
 
-    /*
-     * don't waste time unless new assignment is feasible
-     */
-    if (feasible (new_ts, FALSE) == new_ts->num_tasks) {
+  ts->tasks[t].PT = f->lo[t];
+  thread_partition_moved (&f->part, ts, t);
+}
 
-      if (target == -1 && target_pt_support) {
-	maximize_preempt_thresholds (new_ts);
-	assert (feasible (new_ts, FALSE) == new_ts->num_tasks);
-      }
-      
-      new_thr = optimal_partition_into_threads (new_ts);
-      assert (new_thr > 0 && new_thr <= new_ts->num_tasks);
+int assign_thresholds_for_fewest_threads (struct task_set *ts)
+{
+  struct fewest_threads f;
+  int *orig_pt;
+  int i, j, c, p, d;
+  int n = ts->num_tasks;
 
-      new_cs = find_critical_scale (new_ts, NULL);
+  assert (ts);
+  assert (uses_preempt_thresh_analysis (ts));
+  assert (ts->Analysis.valid (ts));
+  assert (no_zero_wcet (ts));
 
-      /*
-       * don't waste a good result even if it's not what we're
-       * currently looking for 
-       */
-      if (new_cs > best_cs_per_thr[new_thr]) {
-	best_cs_per_thr[new_thr] = new_cs;
-	if (best_ts_per_thr[new_thr]) free_task_set (best_ts_per_thr[new_thr]);
-	best_ts_per_thr[new_thr] = copy_task_set (new_ts);
-      }
+  f.ts = ts;
+  f.order = (int *) xmalloc (n * sizeof (int));
+  f.lo = (int *) xmalloc (n * sizeof (int));
+  f.hi = (int *) xmalloc (n * sizeof (int));
+  f.best_pt = (int *) xmalloc (n * sizeof (int));
+  orig_pt = (int *) xmalloc (n * sizeof (int));
+  f.best = n+1;
+  f.nodes = 0;
+
+  for (i=0; i<n; i++) {
+    orig_pt[i] = ts->tasks[i].PT;
+  }
 
-#if 0 // FIXME!!!
-      /*
-       * if we ever see a "new" number of threads, go ahead and fork
-       * off an annealing to maximize its insensitivity 
-       */
-      if (!optimized[new_thr]) {
-	optimized[new_thr] = 1;
-	anneal_threads_or_cs (copy_task_set(new_ts), 
-			      new_thr, 
-			      optimized, 
-			      best_cs_per_thr,
-			      best_ts_per_thr,
-			      target_pt_support);
-      }
-#endif
+  if (feasible (ts, FALSE) == n) {
+    struct task_set *ts2 = copy_task_set (ts);
+    maximize_preempt_thresholds (ts2);
+    f.best = optimal_partition_into_threads (ts2);
+    for (i=0; i<n; i++) {
+      f.best_pt[i] = ts2->tasks[i].PT;
+    }
+    free_task_set (ts2);
+    DBGPrint (3, ("  %d threads to start with\n", f.best));
+  }
 
-      /*
-       * annealing as usual, except we're optimizing two different
-       * parameters depending on how we were called 
-       */
-      if ((target == -1 && (new_thr < best_thr || rand_double() < temp)) ||
-	  (target != -1 && new_thr == target && (new_cs > best_cs || rand_double() < temp))) {
-	last_improvement = i;
-	best_thr = new_thr;
-	best_cs = new_cs;
-	free_task_set (best_ts);
-	best_ts = copy_task_set (new_ts);
+  /*
+   * no threshold below the priority, none that lets a task preempt
+   * another in its cluster, and none across a barrier
+   */
+  for (i=0; i<n; i++) {
+    f.hi[i] = ts->tasks[i].P;
+  }
+  for (c=0; c<ts->num_task_clusters; c++) {
+    struct task_cluster *cluster = &ts->task_clusters[c];
+    for (i=0; i<cluster->num_tasks; i++) {
+      for (j=0; j<cluster->num_tasks; j++) {
+	int ti = cluster->tasks[i];
+	int tj = cluster->tasks[j];
+	if (ts->tasks[tj].P < f.hi[ti]) f.hi[ti] = ts->tasks[tj].P;
       }
     }
+  }
+  for (i=0; i<n; i++) {
+    f.lo[i] = 0;
+    while (f.lo[i] <= f.hi[i] && !barriers_permit_pri (ts, i, f.lo[i])) {
+      f.lo[i]++;
+    }
+    if (f.lo[i] > f.hi[i]) goto out;
+    ts->tasks[i].PT = f.lo[i];
+  }
 
-    free_task_set (new_ts);
-    temp *= TEMP_SCALE;
-    i++;
-
+  d = 0;
+  for (p=n-1; p>=0; p--) {
+    for (i=0; i<n; i++) {
+      if (ts->tasks[i].P == p) f.order[d++] = i;
+    }
   }
+  assert (d == n);
 
-  assert (best_cs <= best_cs_per_thr[best_thr]);
+  init_thread_partition (&f.part, ts);
+  fewest_threads_from (&f, 0);
+  free_thread_partition (&f.part);
 
-  assert (target == -1 || optimal_partition_into_threads (best_ts) == target);
-  DBGPrint (1, ("  Done with %d.\n", target));
+ out:
+  DBGPrint (2, ("fewest threads: %d after %ld nodes\n",
+		(f.best <= n) ? f.best : 0, f.nodes));
 
-  free_task_set (best_ts);
+  for (i=0; i<n; i++) {
+    ts->tasks[i].PT = (f.best <= n) ? f.best_pt[i] : orig_pt[i];
+  }
+  feasible (ts, FALSE);
+  if (f.best <= n) {
+    optimal_partition_into_threads (ts);
+  } else {
+    f.best = 0;
+  }
+
+  xfree (f.order);
+  xfree (f.lo);
+  xfree (f.hi);
+  xfree (f.best_pt);
+  xfree (orig_pt);
+
+  return f.best;
 }
 
+int ANNEAL_MAX = -1;
+double INIT_TEMP = 0.00;
+double TEMP_SCALE = 0.99;
+
 void ensure_target_doesnt_need_pt (struct task_set *ts)
 {
   assert (ts);
@@ -874,13 +1037,177 @@ void ensure_target_doesnt_need_pt (struct task_set *ts)
   assert (constraints_valid (ts));
 }
 
+/*
+ * fold the per-thread-count records in from_cs and from_ts into cs and
+ * ts, freeing the ones that lose
+ */
+static void merge_thread_records (int ntasks,
+				  double *cs,
+				  struct task_set **ts,
+				  double *from_cs,
+				  struct task_set **from_ts)
+{
+  int i;
+
+  for (i=0; i<=ntasks; i++) {
+    if (!from_ts[i]) continue;
+    if (from_cs[i] > cs[i]) {
+      cs[i] = from_cs[i];
+      if (ts[i]) free_task_set (ts[i]);
+      ts[i] = from_ts[i];
+    } else {
+      free_task_set (from_ts[i]);
+    }
+    from_ts[i] = NULL;
+  }
+}
+
+/*
+ * Searching for fewer threads: the cost is the number of threads, and
+ * each search keeps its own records of the least sensitive assignment
+ * seen for each number of threads, which are merged into the caller's
+ * at the end
+ */
+struct threads_search {
+  int target_pt_support;
+  double *best_cs_per_thr;
+  struct task_set **best_ts_per_thr;
+};
+
+struct threads_state {
+  int target_pt_support;
+  int ntasks;
+  double *best_cs_per_thr;
+  struct task_set **best_ts_per_thr;
+  struct task_set *ts;
+  struct thread_partition part;   // ordered by ts's thresholds
+  int *moved;                     // tasks the move under test changed
+  int num_moved;
+};
+
+static double threads_note (struct task_set *ts,
+			    struct threads_state *r)
+{
+  int thr;
+  double cs;
+
+  thr = partition_into_threads (&r->part, ts);
+  assert (thr > 0 && thr <= ts->num_tasks);
+  cs = find_critical_scale (ts, NULL);
+  if (cs > r->best_cs_per_thr[thr]) {
+    r->best_cs_per_thr[thr] = cs;
+    if (r->best_ts_per_thr[thr]) free_task_set (r->best_ts_per_thr[thr]);
+    r->best_ts_per_thr[thr] = copy_task_set (ts);
+  }
+  return thr;
+}
+
+static void *threads_start (struct task_set *ts, void *arg,
+			    double *cost)
+{
+  struct threads_search *s = (struct threads_search *) arg;
+  struct threads_state *r;
+  int i;
+
+  r = (struct threads_state *) xmalloc (sizeof (struct threads_state));
+  r->target_pt_support = s->target_pt_support;
+  r->ntasks = ts->num_tasks;
+  r->best_cs_per_thr = (double *) xmalloc (sizeof (double) * (1+r->ntasks));
+  r->best_ts_per_thr = (struct task_set **)
+    xmalloc (sizeof (struct task_set *) * (1+r->ntasks));
+  for (i=0; i<=r->ntasks; i++) {
+    r->best_cs_per_thr[i] = 0;
+    r->best_ts_per_thr[i] = NULL;
+  }
+  r->ts = ts;
+  r->moved = (int *) xmalloc (sizeof (int) * r->ntasks);
+  r->num_moved = 0;
+
+  assert (feasible (ts, FALSE) == ts->num_tasks);
+  if (r->target_pt_support) {
+    maximize_preempt_thresholds (ts);
+  }
+  init_thread_partition (&r->part, ts);
+  *cost = threads_note (ts, r);
+  return r;
+}
+
+/*
+ * the partition's order after the tasks in r->moved changed
+ */
+static void threads_reorder (struct threads_state *r)
+{
+  if (r->num_moved == 1) {
+    thread_partition_moved (&r->part, r->ts, r->moved[0]);
+  } else if (r->num_moved > 1) {
+    sort_thread_partition (&r->part, r->ts);
+  }
+}
+
+static double threads_cost (struct task_set *ts, void *state, double bound)
+{
+  struct threads_state *r = (struct threads_state *) state;
+  struct undo_log *u = ts->undo;
+  int i;
+
+  if (feasible (ts, FALSE) != ts->num_tasks) return HUGE_VAL;
+  if (r->target_pt_support) {
+    maximize_preempt_thresholds (ts);
+  }
+  for (i=0; i<u->num_entries; i++) {
+    if (u->entries[i].what >= 0) {
+      r->moved[r->num_moved++] = u->entries[i].what;
+    }
+  }
+  threads_reorder (r);
+  return threads_note (ts, r);
+}
+
+/*
+ * a rejected move has put the thresholds back
+ */
+static void threads_settle (void *state, int accepted)
+{
+  struct threads_state *r = (struct threads_state *) state;
+
+  if (!accepted) {
+    threads_reorder (r);
+  }
+  r->num_moved = 0;
+}
+
+static void threads_finish (void *state, void *arg)
+{
+  struct threads_state *r = (struct threads_state *) state;
+  struct threads_search *s = (struct threads_search *) arg;
+
+  merge_thread_records (r->ntasks, s->best_cs_per_thr, s->best_ts_per_thr,
+			r->best_cs_per_thr, r->best_ts_per_thr);
+  xfree (r->best_cs_per_thr);
+  xfree (r->best_ts_per_thr);
+  xfree (r->moved);
+  free_thread_partition (&r->part);
+  xfree (r);
+}
+
+/*
+ * Given a feasible assignment of priorities and preemption
+ * thresholds, attempt to adjust priorities and thresholds in order to
+ * reduce the number of threads onto which they are assigned; this has
+ * the obvious side effect of increasing the sensitivity of the task
+ * set.
+ */
 void minimize_threads_by_annealing (struct task_set *ts1,
 				    int test_overrun,
 				    int target_pt_support)
 {
-  int *optimized;
   double *best_cs_per_thr;
   struct task_set **best_ts_per_thr;
+  struct threads_search search;
+  struct assignment_moves m;
+  struct search_neighbourhood nb;
+  struct search_objective obj;
+  struct search s;
   int i, ntasks;
   int least_threads, highest_cs;
 
@@ -898,23 +1225,39 @@ void minimize_threads_by_annealing (struct task_set *ts1,
 
   ntasks = ts1->num_tasks;
 
-  optimized = (int *) xmalloc (sizeof (int) * (1+ntasks));
   best_cs_per_thr = (double *) xmalloc (sizeof (double) * (1+ntasks));
   best_ts_per_thr = (struct task_set **) 
     xmalloc (sizeof (struct task_set *) * (1+ntasks));
 
   for (i=0; i<=ntasks; i++) {
-    optimized[i] = FALSE;
     best_cs_per_thr[i] = 0;
     best_ts_per_thr[i] = NULL;
   }
 
-  anneal_threads_or_cs (ts1, 
-			-1,
-			optimized, 
-			best_cs_per_thr, 
-			best_ts_per_thr, 
-			target_pt_support);
+  search.target_pt_support = target_pt_support;
+  search.best_cs_per_thr = best_cs_per_thr;
+  search.best_ts_per_thr = best_ts_per_thr;
+
+  m.PT = TRUE;
+  m.target_pt_support = target_pt_support;
+  m.preemptible = -1;
+  init_assignment_neighbourhood (&nb, &m);
+
+  obj.start = threads_start;
+  obj.cost = threads_cost;
+  obj.settle = threads_settle;
+  obj.finish = threads_finish;
+  obj.slack = NULL;
+  obj.goal = -HUGE_VAL;
+  obj.arg = &search;
+
+  s.obj = &obj;
+  s.moves = &nb;
+  s.strategy = SEARCH_STRATEGY;
+  s.patience = ANNEAL_MAX;
+
+  search_with_replicas (&ts1, &s);
+  free_task_set (ts1);
 
   least_threads = highest_cs = -1;
   for (i=1; i<=ntasks; i++) {
@@ -975,7 +1318,6 @@ void minimize_threads_by_annealing (struct task_set *ts1,
     }
   }
 
-  xfree (optimized);
   xfree (best_cs_per_thr);
   xfree (best_ts_per_thr);
 }
@@ -985,52 +1327,76 @@ void minimize_threads_by_annealing (struct task_set *ts1,
  * the thresholds as much as possible without destroying schedulability.
  *
  * This is from Figure 4 of Saksena and Wang 00.
+ *
+ * Raising task i's threshold from PT to PT-1 stops the task at
+ * priority PT-1 from preempting it, so that task, and only that task,
+ * picks up i as a new source of blocking; nothing else's response time
+ * changes.  So each step rechecks just that level, found through an
+ * index of the tasks at each priority.  Build with CHECK_PREEMPT_THRESH
+ * to analyze the whole set after every step as well.
  */
 void maximize_preempt_thresholds (struct task_set *ts)
 {
   int i, j, rj;
   int cur_pri;
+  int *head, *next;
 
   assert (ts);
   assert (uses_preempt_thresh_analysis (ts));
   assert (ts->Analysis.valid (ts));  
   assert (no_zero_wcet (ts));
 
+  // head[p] .. next[] lists the tasks at priority p in index order
+  head = (int *) xmalloc (ts->num_tasks * sizeof (int));
+  next = (int *) xmalloc (ts->num_tasks * sizeof (int));
   for (cur_pri=0; cur_pri<ts->num_tasks; cur_pri++) {
-    for (i=0; i<ts->num_tasks; i++) {
-      if (ts->tasks[i].P == cur_pri) {
-    	int schedulable = TRUE;
-	    while (schedulable && ts->tasks[i].PT > 0) {
-	      int k;
-	      for (k=0; k<ts->num_task_barriers; k++) {
-	        if (i > ts->task_barriers[k] &&
-		         (ts->tasks[i].PT-1) <= ts->task_barriers[k]) {
-	          schedulable = FALSE;
-	          goto out;
-	        }
-	      }
-	      DBGPrint (3, ("trying to raise PT of task %d to %d\n",
-			i, ts->tasks[i].PT-1));
-	      ts->tasks[i].PT--;
-	      for (j=0; j<ts->num_tasks; j++) {
-	        if (ts->tasks[j].P == ts->tasks[i].PT) {
-	          rj = ts->Analysis.response_time (ts, j, 0);
-	          if (rj > ts->tasks[j].D) {
-		        assert (schedulable);
-		        schedulable = FALSE;
-		        ts->tasks[i].PT++;
-		        goto out;
-	          }
-	        }
-	      }
-	      assert (feasible (ts, FALSE) == ts->num_tasks);
-out:
-	      ;
-	    }
+    head[cur_pri] = -1;
+  }
+  for (i=ts->num_tasks-1; i>=0; i--) {
+    int p = ts->tasks[i].P;
+    if (p >= 0 && p < ts->num_tasks) {
+      next[i] = head[p];
+      head[p] = i;
+    }
+  }
+
+  for (cur_pri=0; cur_pri<ts->num_tasks; cur_pri++) {
+    for (i=head[cur_pri]; i!=-1; i=next[i]) {
+      int schedulable = TRUE;
+      while (schedulable && ts->tasks[i].PT > 0) {
+	int k;
+	for (k=0; k<ts->num_task_barriers; k++) {
+	  if (i > ts->task_barriers[k] &&
+	      (ts->tasks[i].PT-1) <= ts->task_barriers[k]) {
+	    schedulable = FALSE;
+	    goto out;
+	  }
+	}
+	DBGPrint (3, ("trying to raise PT of task %d to %d\n",
+		      i, ts->tasks[i].PT-1));
+	save_task_pri (ts, i);
+	ts->tasks[i].PT--;
+	for (j=head[ts->tasks[i].PT]; j!=-1; j=next[j]) {
+	  rj = ts->Analysis.response_time (ts, j, 0);
+	  if (rj > ts->tasks[j].D) {
+	    schedulable = FALSE;
+	    ts->tasks[i].PT++;
+	    goto out;
+	  }
+	}
+#ifdef CHECK_PREEMPT_THRESH
+	assert (feasible (ts, FALSE) == ts->num_tasks);
+#endif
+      out:
+	;
       }
     }
   }
 
+  xfree (head);
+  xfree (next);
+
+  // also leaves every task's R up to date for the caller
   if (feasible (ts, FALSE) != ts->num_tasks) {
     print_task_set (ts);
     fflush (stdout);
@@ -1046,37 +1412,192 @@ enum which_energy { MAX = 0x233, SUM, SQUARED };
  * This is the energy function for the simulated annealing algorithm
  * presented in Figure 2 of Saksena and Wang 00.  It is simply the
  * total lateness for all tasks for a given priority assignment, after
- * optimal preemption thresholds are assigned.  
+ * optimal preemption thresholds are assigned.  Lateness is never
+ * negative, so the energy of some of the tasks is never more than
+ * that of all of them.
  */
-static time_value energy (struct task_set *ts)
+static const enum which_energy which = SQUARED;
+
+static double add_energy (double e, time_value pos_late)
+{
+  switch (which) {
+  case MAX:
+    e = my_max (e, pos_late);
+    break;
+  case SUM:
+    e += pos_late;
+    break;
+  case SQUARED:
+    e += (double) pos_late * (double) pos_late;
+    break;
+  default:
+    assert (0);
+  }
+  return e;
+}
+
+static time_value finish_energy (double e)
+{
+  if (which == SQUARED) e = sqrt (e);
+
+  return (time_value)e;
+}
+
+static time_value total_energy (int n, const time_value *late)
 {
   int i;
-  // time_value e = 0;
   double e = 0;
-  const enum which_energy which = SQUARED;
-  
+
+  for (i=0; i<n; i++) {
+    e = add_energy (e, late[i]);
+  }
+
+  return finish_energy (e);
+}
+
+static time_value energy (struct task_set *ts, time_value *late)
+{
+  int i;
+
   for (i=0; i<ts->num_tasks; i++) {
-    time_value pos_late = lateness (ts, i);
-    switch (which) {
-    case MAX:
-      e = my_max (e, pos_late);
-      break;
-    case SUM:
-      e += pos_late;
-      break;
-    case SQUARED:
-      e += (double) pos_late * (double) pos_late;
-      break;
-    default:
-      assert (0);
+    late[i] = lateness (ts, i);
+  }
+
+  return total_energy (ts->num_tasks, late);
+}
+
+/*
+ * How task j, with priority Pj and threshold PTj, enters the response
+ * time analysis of task i: by preempting it before it starts, by
+ * preempting it once it runs, or by blocking it.  These relations are
+ * all that the preemption threshold analyses look at, so a task whose
+ * relations to every other task are unchanged keeps its response time.
+ */
+static int relation (int Pi, int PTi, int Pj, int PTj)
+{
+  return (Pj < Pi) | ((Pj < PTi) << 1) | ((PTj <= Pi && Pi < Pj) << 2);
+}
+
+/*
+ * The energy after the move recorded in ts's undo log, given the
+ * lateness of each task before the move.  Only tasks whose relation
+ * to some other task changed are reanalyzed; the rest keep their old
+ * lateness, unless the move changed a WCET.  Once the energy so far
+ * is above bound the rest are not looked at and HUGE_VAL is returned,
+ * leaving new_late incomplete.  old_P and old_PT are scratch space
+ * for num_tasks ints.
+ */
+static double energy_after_move (struct task_set *ts,
+				 const time_value *late,
+				 time_value *new_late,
+				 int *old_P,
+				 int *old_PT,
+				 double bound)
+{
+  struct undo_log *u = ts->undo;
+  int i, j;
+  double e = 0;
+
+  for (i=0; i<ts->num_tasks; i++) {
+    old_P[i] = ts->tasks[i].P;
+    old_PT[i] = ts->tasks[i].PT;
+  }
+  for (i=0; i<u->num_entries; i++) {
+    int t = u->entries[i].what;
+    if (t < 0) continue;
+    old_P[t] = u->entries[i].P;
+    old_PT[t] = u->entries[i].PT;
+#ifdef USE_DVS
+    if (u->entries[i].C != ts->tasks[t].C) {
+      return energy (ts, new_late);
     }
+#endif
   }
-    
-  if (which == SQUARED) e = sqrt (e);
 
-  // printf ("%lld\n", e);
+  for (i=0; i<ts->num_tasks; i++) {
+    int Pi = ts->tasks[i].P, PTi = ts->tasks[i].PT;
+    int moved = (old_P[i] != Pi || old_PT[i] != PTi);
+
+    new_late[i] = late[i];
+    for (j=0; j<ts->num_tasks; j++) {
+      int Pj = ts->tasks[j].P, PTj = ts->tasks[j].PT;
+      if (j == i) continue;
+      if (!moved && old_P[j] == Pj && old_PT[j] == PTj) continue;
+      if (relation (old_P[i], old_PT[i], old_P[j], old_PT[j]) !=
+	  relation (Pi, PTi, Pj, PTj)) {
+	new_late[i] = lateness (ts, i);
+	break;
+      }
+    }
 
-  return (time_value)e;
+    e = add_energy (e, new_late[i]);
+    if (finish_energy (e) > bound) return HUGE_VAL;
+  }
+
+  return finish_energy (e);
+}
+
+/*
+ * R of a task that a rejected move reanalyzed describes that move
+ */
+static void recompute_lateness (struct task_set *ts)
+{
+  int i;
+
+  for (i=0; i<ts->num_tasks; i++) {
+    lateness (ts, i);
+  }
+}
+
+/*
+ * the lateness of every task under the current assignment, so that a
+ * move only reanalyzes the tasks it affects
+ */
+struct lateness_state {
+  time_value *late, *new_late;
+  int *old_P, *old_PT;
+};
+
+static void *lateness_start (struct task_set *ts, void *arg, double *cost)
+{
+  struct lateness_state *r = (struct lateness_state *) xmalloc (sizeof (struct lateness_state));
+
+  r->late = (time_value *) xmalloc (sizeof (time_value) * ts->num_tasks);
+  r->new_late = (time_value *) xmalloc (sizeof (time_value) * ts->num_tasks);
+  r->old_P = (int *) xmalloc (sizeof (int) * ts->num_tasks);
+  r->old_PT = (int *) xmalloc (sizeof (int) * ts->num_tasks);
+  *cost = energy (ts, r->late);
+  return r;
+}
+
+static double lateness_cost (struct task_set *ts, void *state, double bound)
+{
+  struct lateness_state *r = (struct lateness_state *) state;
+
+  return energy_after_move (ts, r->late, r->new_late, r->old_P, r->old_PT,
+			    bound);
+}
+
+static void lateness_settle (void *state, int accepted)
+{
+  struct lateness_state *r = (struct lateness_state *) state;
+
+  if (accepted) {
+    time_value *tmp = r->late;
+    r->late = r->new_late;
+    r->new_late = tmp;
+  }
+}
+
+static void lateness_finish (void *state, void *arg)
+{
+  struct lateness_state *r = (struct lateness_state *) state;
+
+  xfree (r->late);
+  xfree (r->new_late);
+  xfree (r->old_P);
+  xfree (r->old_PT);
+  xfree (r);
 }
 
 /*
@@ -1089,13 +1610,13 @@ static time_value energy (struct task_set *ts)
 int anneal_priorities_and_thresholds (struct task_set **ts,
 				      int target_pt_support)
 {
-  int best_en, new_en;
-  double temp = INIT_TEMP;
-  struct task_set *new_ts, *best_ts;
+  struct task_set *best_ts;
   struct task_set *orig_ts;
-  int i;
-  int last_improvement = 0;
-  int total_improvements = 0;
+  struct assignment_moves m;
+  struct search_neighbourhood nb;
+  struct search_objective obj;
+  struct search s;
+  int found, feas;
 
   assert (ANNEAL_MAX != -1);
 
@@ -1105,8 +1626,7 @@ int anneal_priorities_and_thresholds (struct task_set **ts,
   assert (orig_ts);
   assert (uses_preempt_thresh_analysis (orig_ts));
 
-  best_ts = copy_task_set (orig_ts);
-  free_task_set (orig_ts);
+  best_ts = orig_ts;
 
   if (target_pt_support) {
     set_priorities (best_ts, DM);
@@ -1121,61 +1641,37 @@ int anneal_priorities_and_thresholds (struct task_set **ts,
 
   assert (best_ts->Analysis.valid (best_ts));
 
-  best_en = energy (best_ts);
-
-  i = 0;
-  while (i < last_improvement + ANNEAL_MAX) {
-
-    new_ts = copy_task_set (best_ts);
-
-    if (target_pt_support) {
-      permute_pri_and_thresh (new_ts);
-      respect_constraints_randomly (new_ts);
-    } else {
-      permute_npt (new_ts);
-    }
+  m.PT = TRUE;
+  m.target_pt_support = target_pt_support;
+  m.preemptible = -1;
+  init_assignment_neighbourhood (&nb, &m);
 
-    new_en = energy (new_ts);
+  obj.start = lateness_start;
+  obj.cost = lateness_cost;
+  obj.settle = lateness_settle;
+  obj.finish = lateness_finish;
+  obj.slack = NULL;
+  obj.goal = 0;
+  obj.arg = NULL;
 
-    if (i%100 == 0) {
-      DBGPrint (3, ("%d : best = %d,  new = %d,  temp = %f\n", 
-		    i, best_en, new_en, temp));
-    }
+  s.obj = &obj;
+  s.moves = &nb;
+  s.strategy = SEARCH_STRATEGY;
+  s.patience = ANNEAL_MAX;
 
-    if (new_en == 0) {
-      *ts = new_ts;
-      free_task_set (best_ts);
-      if (!target_pt_support) {
-	ensure_target_doesnt_need_pt (new_ts);
-      }
-      assert (feasible (new_ts, TRUE) == num_tasks (new_ts));
-      return TRUE;
-    }
-    
-    if ((new_en <= best_en ||
-	 rand_double() < temp)) {
-      if (new_en < best_en) {
-	last_improvement = i;
-	total_improvements++;
-      }
-      best_en = new_en;
-      free_task_set (best_ts);
-      best_ts = copy_task_set (new_ts);
-    }
+  found = (search_with_replicas (&best_ts, &s) == 0);
+  if (!found) recompute_lateness (best_ts);
 
-    free_task_set (new_ts);
-    temp *= TEMP_SCALE;
-    i++;
+  *ts = best_ts;
 
+  if (found && !target_pt_support) {
+    ensure_target_doesnt_need_pt (best_ts);
   }
 
-  DBGPrint (3, ("anneal_priorities_and_thresholds failed after %d tries; final temp %f\n", 
-		i, temp));
-
-  feasible (best_ts, TRUE);
-
-  *ts = best_ts;
-  return FALSE;
+  // R and S still describe the last move tried
+  feas = feasible (best_ts, TRUE);
+  assert (!found || feas == num_tasks (best_ts));
+  return found;
 }
 
 #ifdef USE_DVS
@@ -1194,7 +1690,7 @@ void set_task_frequency_level(struct task_set *ts, int t, freq_level f)
 	assert (ts);
 	assert (t < num_tasks(ts));
 	assert (f >= MIN_FREQ_LEVEL);
-	assert (f <= MAX_FREQ_LEVEL);
+	assert (f <= get_max_frequency_level(ts));
 
 	DBGPrint(3,("change %s frequency level from %d to %d.\n",
 				ts->tasks[t].name,
@@ -1204,7 +1700,8 @@ void set_task_frequency_level(struct task_set *ts, int t, freq_level f)
 	if(get_task_frequency_level(ts,t) == f)
 		return;
 
-	C = modify_task_C_by_freq(get_Cu(ts, t), valid_f_scale[f]);
+	C = get_task_wcet_at_level(ts,t,f);
+	save_task_freq(ts,t);
 	set_wcet(ts,t,C);
 	ts->tasks[t].f = f;
 }
@@ -1215,7 +1712,7 @@ void inc_task_frequency_level(struct task_set *ts, int t)
 	assert (t < num_tasks(ts));
 
 	freq_level f = get_task_frequency_level(ts,t);
-	f += (f < MAX_FREQ_LEVEL)? 1: 0;
+	f += (f < get_max_frequency_level(ts))? 1: 0;
 	set_task_frequency_level(ts,t,f);
 }
 
@@ -1241,7 +1738,7 @@ void set_task_set_frequency_level(struct task_set *ts, freq_level f)
 {
 	assert (ts);
 	assert (f >= MIN_FREQ_LEVEL);
-	assert (f <= MAX_FREQ_LEVEL);
+	assert (f <= get_max_frequency_level(ts));
 
 	if(get_task_set_frequency_level(ts) == f)
 		return;
@@ -1258,7 +1755,7 @@ void inc_task_set_frequency_level(struct task_set *ts)
 	assert (ts);
 
 	freq_level f = get_task_set_frequency_level(ts);
-	f += (f < MAX_FREQ_LEVEL)? 1: 0;
+	f += (f < get_max_frequency_level(ts))? 1: 0;
 	set_task_set_frequency_level(ts,f);
 }
 
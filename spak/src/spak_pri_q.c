@@ -133,6 +133,47 @@ void pri_q_insert (time_value key, void *ptr)
   the_heap[i].ptr = ptr;
 }
 
+/*
+ * the remaining accessors let the simulator look at (and time-shift)
+ * the pending events without disturbing the heap order
+ */
+time_value pri_q_min_key (void)
+{
+  assert (the_heap);
+
+  if (heap_size == 0) return -1;
+  return the_heap[0].key;
+}
+
+unsigned int pri_q_size (void)
+{
+  assert (the_heap);
+  return heap_size;
+}
+
+void *pri_q_elt (unsigned int i, time_value *key)
+{
+  assert (the_heap);
+  assert (i < heap_size);
+
+  if (key) *key = the_heap[i].key;
+  return the_heap[i].ptr;
+}
+
+/*
+ * adding the same amount to every key preserves the heap property
+ */
+void pri_q_shift_keys (time_value delta)
+{
+  unsigned int i;
+
+  assert (the_heap);
+
+  for (i=0; i<heap_size; i++) {
+    the_heap[i].key += delta;
+  }
+}
+
 void init_pri_q (void)
 {
   assert (!the_heap);
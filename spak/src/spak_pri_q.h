@@ -7,4 +7,8 @@ extern void init_pri_q (void);
 extern void deinit_pri_q (void);
 extern time_value pri_q_extract_min (void **addr);
 extern void pri_q_insert (time_value key, void *ptr);
+extern time_value pri_q_min_key (void);
+extern unsigned int pri_q_size (void);
+extern void *pri_q_elt (unsigned int i, time_value *key);
+extern void pri_q_shift_keys (time_value delta);
 #endif
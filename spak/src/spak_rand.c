@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2002 University of Utah and the Flux Group.
+ * All rights reserved.
+ *
+ * This file is part of SPAK.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation is hereby granted without fee, provided that the
+ * above copyright notice and this permission/disclaimer notice is
+ * retained in all copies or modified versions, and that both notices
+ * appear in supporting documentation.  THE COPYRIGHT HOLDERS PROVIDE
+ * THIS SOFTWARE "AS IS" AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE COPYRIGHT
+ * HOLDERS DISCLAIM ANY LIABILITY OF ANY KIND FOR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Users are requested, but not required, to send to csl-dist@cs.utah.edu
+ * any improvements that they make and grant redistribution rights to the
+ * University of Utah.
+ *
+ * Author: John Regehr (regehr@cs.utah.edu)
+ */
+
+/*
+ * Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as
+ * 1, 2, 3", SC 2011).  The seed is the key; the counter holds a 64-bit
+ * block number in its low half and the stream id in its high half, so
+ * each (seed, stream) pair gives an independent sequence of 2^64
+ * blocks of four 32-bit words.
+ */
+
+#include "spak_public.h"
+#include "spak_internal.h"
+
+#define PHILOX_M0 0xD2511F53u
+#define PHILOX_M1 0xCD9E8D57u
+#define PHILOX_W0 0x9E3779B9u
+#define PHILOX_W1 0xBB67AE85u
+
+#ifdef WIN32
+static __declspec(thread) struct spak_rng* cur_rng;
+#else
+static __thread struct spak_rng* cur_rng;
+#endif
+
+static void philox4x32_10 (const uint32_t ctr[4],
+                           const uint32_t key[2],
+                           uint32_t out[4])
+{
+    uint32_t c0 = ctr[0], c1 = ctr[1], c2 = ctr[2], c3 = ctr[3];
+    uint32_t k0 = key[0], k1 = key[1];
+    int i;
+
+    for (i=0; i<10; i++) {
+        uint64_t p0 = (uint64_t)PHILOX_M0 * c0;
+        uint64_t p1 = (uint64_t)PHILOX_M1 * c2;
+
+        c0 = (uint32_t)(p1 >> 32) ^ c1 ^ k0;
+        c1 = (uint32_t)p1;
+        c2 = (uint32_t)(p0 >> 32) ^ c3 ^ k1;
+        c3 = (uint32_t)p0;
+
+        k0 += PHILOX_W0;
+        k1 += PHILOX_W1;
+    }
+
+    out[0] = c0;
+    out[1] = c1;
+    out[2] = c2;
+    out[3] = c3;
+}
+
+void spak_rng_init (struct spak_rng* r, uint64_t seed, uint64_t stream)
+{
+    assert (r);
+
+    r->key[0] = (uint32_t)seed;
+    r->key[1] = (uint32_t)(seed >> 32);
+    r->ctr[0] = 0;
+    r->ctr[1] = 0;
+    r->ctr[2] = (uint32_t)stream;
+    r->ctr[3] = (uint32_t)(stream >> 32);
+    r->used = 4;
+}
+
+static inline uint32_t next_word (struct spak_rng* r)
+{
+    if (r->used == 4) {
+        philox4x32_10 (r->ctr, r->key, r->out);
+        if (++r->ctr[0] == 0) r->ctr[1]++;
+        r->used = 0;
+    }
+    return r->out[r->used++];
+}
+
+/*
+ * uniform on [0,1) with 53 random bits, like drand48()
+ */
+double spak_rng_double (struct spak_rng* r)
+{
+    uint32_t a = next_word (r) >> 5;
+    uint32_t b = next_word (r) >> 6;
+
+    return (a * 67108864.0 + b) / 9007199254740992.0;
+}
+
+/*
+ * uniform on [0,2^31), like lrand48()
+ */
+long int spak_rng_long (struct spak_rng* r)
+{
+    return (long int)(next_word (r) >> 1);
+}
+
+struct spak_rng* spak_rng_select (struct spak_rng* r)
+{
+    struct spak_rng* old = cur_rng;
+    cur_rng = r;
+    return old;
+}
+
+struct spak_rng* spak_rng_current (void)
+{
+    return cur_rng;
+}
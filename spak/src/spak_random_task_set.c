@@ -202,7 +202,7 @@ restart:
                       (T/multiplier)*multiplier, 1,
                       (D/multiplier)*multiplier,
                       (J/multiplier)*multiplier, 0,
-                      MAX_FREQ_LEVEL,
+                      get_max_frequency_level (ts),
                       name);
     }
 #else
@@ -230,3 +230,32 @@ restart:
 
     return ts;
 }
+
+struct task_set* create_random_task_set_with_utilization_rng (int num,
+        int total_tasks,
+        int max_deadline,
+        const char* analysis,
+        int multiplier,
+        double set_u,
+        int has_jitter,
+        int has_independent_deadline,
+        struct spak_rng* rng)
+{
+    struct task_set* ts;
+    struct spak_rng* old;
+
+    assert (rng);
+
+    old = spak_rng_select (rng);
+    ts = create_random_task_set_with_utilization (num,
+            total_tasks,
+            max_deadline,
+            analysis,
+            multiplier,
+            set_u,
+            has_jitter,
+            has_independent_deadline);
+    spak_rng_select (old);
+
+    return ts;
+}
@@ -24,6 +24,7 @@
 
 #include "spak_public.h"
 #include "spak_internal.h"
+#include <pthread.h>
 
 #define DBG_LEVEL 3
 
@@ -50,8 +51,13 @@ static int sched_scale (struct task_set *ts,
 
 #define THRESH 0.00001
 
-double find_critical_scale (struct task_set *ts,
-			    struct task_set **ts2)
+/*
+ * also reports, through above, the unschedulable end of the final
+ * bracket, which is the least factor the bisection would rank higher
+ */
+static double critical_scale (struct task_set *ts,
+			      struct task_set **ts2,
+			      double *above)
 {
   time_value *Corig;
   int i;
@@ -124,9 +130,16 @@ double find_critical_scale (struct task_set *ts,
 
   // printf ("exiting find_critical_scale\n");
 
+  if (above) *above = high;
   return low;
 }
 
+double find_critical_scale (struct task_set *ts,
+			    struct task_set **ts2)
+{
+  return critical_scale (ts, ts2, NULL);
+}
+
 static void apply_scale (double scale, 
 			 struct task_set *orig,
 			 struct task_set *scaled)
@@ -236,8 +249,10 @@ static void permute_thresh_once (struct task_set *ts)
   int t = rand_long() % ts->num_tasks;
   if (rand_double() < 0.5) {
     int new_pt = rand_long() % ts->num_tasks;
+    save_task_pri (ts, t);
     ts->tasks[t].PT = new_pt;
   } else {
+    save_task_pri (ts, t);
     if (rand_double() < 0.5) {
       ts->tasks[t].PT++;
     } else {
@@ -268,6 +283,7 @@ void permute_pri_and_thresh (struct task_set *ts)
   for (t=0; t<ts->num_tasks; t++) {
     if (ts->tasks[t].PT > ts->tasks[t].P ||
 	ts->tasks[t].PT < 0) {
+      save_task_pri (ts, t);
       if (ts->tasks[t].P == 0) {
 	ts->tasks[t].PT = 0;
       } else {
@@ -323,6 +339,8 @@ void set_preemption_thresholds_npt (struct task_set *ts)
     assert (maxp != ts->num_tasks+1);
     for (j=0; j<ts->task_clusters[i].num_tasks; j++) {
       int t = ts->task_clusters[i].tasks[j];
+      if (ts->tasks[t].PT == maxp) continue;
+      save_task_pri (ts, t);
       ts->tasks[t].PT = maxp;
     }
   }
@@ -385,6 +403,7 @@ static void join_clusters (struct task_set *ts, int i, int j)
   int k;
   for (k=0; k<ts->task_clusters[i].num_tasks; k++) {
     int t = ts->task_clusters[i].tasks[k];
+    save_task_pri (ts, t);
     ts->tasks[t].PT = ts->tasks[ts->task_clusters[j].tasks[0]].PT;
   }
 }
@@ -434,6 +453,8 @@ void permute_npt (struct task_set *ts)
     // print_cluster (ts, c);
     // printf ("t1 = %d, t2 = %d\n", t1, t2);
     assert (ts->tasks[t1].PT == ts->tasks[t2].PT);
+    save_task_pri (ts, t1);
+    save_task_pri (ts, t2);
     tmp = ts->tasks[t1].P;
     ts->tasks[t1].P = ts->tasks[t2].P;
     ts->tasks[t2].P = tmp;
@@ -460,10 +481,15 @@ void permute_npt (struct task_set *ts)
 
 #ifdef JOIN_CLUSTERS
   if (rand_double() < 0.5) {
+    int c;
     if (rand_double() < 0.65) {
-      ts->task_clusters[rand_long()%ts->num_task_clusters].merge = 0;
+      c = rand_long()%ts->num_task_clusters;
+      save_cluster_merge (ts, c);
+      ts->task_clusters[c].merge = 0;
     } else {
-      ts->task_clusters[rand_long()%ts->num_task_clusters].merge = 1;      
+      c = rand_long()%ts->num_task_clusters;
+      save_cluster_merge (ts, c);
+      ts->task_clusters[c].merge = 1;
     }
   }
   set_preemption_thresholds_npt_joined (ts);
@@ -475,16 +501,214 @@ void permute_npt (struct task_set *ts)
   }
 }
 
+/*
+ * how the annealers perturb an assignment
+ */
+static void assignment_move (struct task_set *ts, void *arg)
+{
+  const struct assignment_moves *m = (const struct assignment_moves *) arg;
+
+  if (m->PT) {
+    if (m->target_pt_support) {
+      permute_pri_and_thresh (ts);
+      respect_constraints_randomly (ts);
+    } else {
+      permute_npt (ts);
+    }
+  } else {
+    permute_pri (ts);
+    if (m->preemptible) {
+      make_all_preemptible (ts);
+    } else {
+      make_all_nonpreemptible (ts);
+    }
+  }
+}
+
+/*
+ * The same kinds of change, listed one by one: swapping two tasks'
+ * priorities and, with thresholds, stepping one threshold or swapping
+ * two clusters.  Pair k of m things is (a, b) with a < b.
+ */
+static int num_pairs (int m)
+{
+  return m * (m-1) / 2;
+}
+
+static void nth_pair (int k, int m, int *a, int *b)
+{
+  int i = 0;
+
+  while (k >= m-1-i) {
+    k -= m-1-i;
+    i++;
+  }
+  *a = i;
+  *b = i+1+k;
+}
+
+static void swap_pri (struct task_set *ts, int a, int b, int with_pt)
+{
+  int tmp;
+
+  save_task_pri (ts, a);
+  save_task_pri (ts, b);
+  tmp = ts->tasks[a].P;
+  ts->tasks[a].P = ts->tasks[b].P;
+  ts->tasks[b].P = tmp;
+  if (with_pt) {
+    tmp = ts->tasks[a].PT;
+    ts->tasks[a].PT = ts->tasks[b].PT;
+    ts->tasks[b].PT = tmp;
+  }
+}
+
+static int assignment_size (struct task_set *ts, void *arg)
+{
+  const struct assignment_moves *m = (const struct assignment_moves *) arg;
+  int c, size;
+
+  if (!m->PT) {
+    return num_pairs (ts->num_tasks);
+  } else if (m->target_pt_support) {
+    return num_pairs (ts->num_tasks) + 2 * ts->num_tasks;
+  } else {
+    size = num_pairs (ts->num_task_clusters);
+    for (c=0; c<ts->num_task_clusters; c++) {
+      size += num_pairs (ts->task_clusters[c].num_tasks);
+    }
+    return size;
+  }
+}
+
+static void assignment_nth (struct task_set *ts, int k, void *arg)
+{
+  const struct assignment_moves *m = (const struct assignment_moves *) arg;
+  int a, b, c;
+
+  if (!m->PT) {
+    nth_pair (k, ts->num_tasks, &a, &b);
+    swap_pri (ts, a, b, FALSE);
+    if (m->preemptible) {
+      ts->tasks[a].PT = ts->tasks[a].P;
+      ts->tasks[b].PT = ts->tasks[b].P;
+    }
+  } else if (m->target_pt_support) {
+    if (k < num_pairs (ts->num_tasks)) {
+      nth_pair (k, ts->num_tasks, &a, &b);
+      swap_pri (ts, a, b, TRUE);
+    } else {
+      int t, pt;
+      k -= num_pairs (ts->num_tasks);
+      t = k / 2;
+      pt = ts->tasks[t].PT + ((k % 2) ? 1 : -1);
+      if (pt < 0 || pt > ts->tasks[t].P) return;
+      save_task_pri (ts, t);
+      ts->tasks[t].PT = pt;
+    }
+    respect_constraints (ts);
+  } else {
+    for (c=0; c<ts->num_task_clusters; c++) {
+      struct task_cluster *cluster = &ts->task_clusters[c];
+      if (k < num_pairs (cluster->num_tasks)) {
+	nth_pair (k, cluster->num_tasks, &a, &b);
+	swap_pri (ts, cluster->tasks[a], cluster->tasks[b], FALSE);
+	return;
+      }
+      k -= num_pairs (cluster->num_tasks);
+    }
+    nth_pair (k, ts->num_task_clusters, &a, &b);
+    if (!can_swap_clusters (ts, a, b)) return;
+    swap_clusters (ts, a, b);
+    set_preemption_thresholds_npt (ts);
+  }
+}
+
+void init_assignment_neighbourhood (struct search_neighbourhood *nb,
+				    struct assignment_moves *m)
+{
+  nb->move = assignment_move;
+  nb->size = assignment_size;
+  nb->nth = assignment_nth;
+  nb->arg = m;
+}
+
+#ifdef USE_DVS
+static int freq_step_size (struct task_set *ts, void *arg)
+{
+  return 2 * ts->num_tasks;
+}
+
+static void freq_step_nth (struct task_set *ts, int k, void *arg)
+{
+  int t = k / 2;
+  int f = get_task_frequency_level (ts, t) + ((k % 2) ? 1 : -1);
+
+  if (f < MIN_FREQ_LEVEL || f > get_max_frequency_level (ts)) return;
+  set_task_frequency_level (ts, t, f);
+}
+
+static void freq_step_move (struct task_set *ts, void *arg)
+{
+  freq_step_nth (ts, rand_long() % freq_step_size (ts, arg), arg);
+}
+
+const struct search_neighbourhood freq_step_moves = {
+  freq_step_move, freq_step_size, freq_step_nth, NULL
+};
+#endif
+
+/*
+ * Searching for a less sensitive assignment: the cost is the negated
+ * critical scaling factor.  Checking that the assignment survives
+ * scaling by -bound is much cheaper than finding its factor, so moves
+ * that would be rejected are caught that way.
+ */
+static void *scale_start (struct task_set *ts, void *arg, double *cost)
+{
+  *cost = -find_critical_scale (ts, NULL);
+  return arg;
+}
+
+static double scale_cost (struct task_set *ts, void *state, double bound)
+{
+  double c;
+
+  if (bound == HUGE_VAL) {
+    return -find_critical_scale (ts, NULL);
+  }
+  if (!test_critical_scale (ts, -bound)) {
+    return HUGE_VAL;
+  }
+  c = -find_critical_scale (ts, NULL);
+  // the bisection can end a hair below a factor just shown to work
+  return (c > bound) ? bound : c;
+}
+
+/*
+ * annealing may give up at most half of the margin above 1 at a time
+ */
+static double scale_slack (void *state, double cost)
+{
+  return -(1 + (-cost - 1.0) / 2);
+}
+
+static double insensitivity_cost (struct task_set *ts, void *state,
+				  double bound)
+{
+  if (feasible (ts, FALSE) != ts->num_tasks) return HUGE_VAL;
+  return scale_cost (ts, state, bound);
+}
+
 struct task_set *maximize_insensitivity_by_annealing (struct task_set *orig_ts,
 						      int PT,
 						      int target_pt_support)
 {
-  double best_bd, new_bd;
-  double temp = INIT_TEMP;
-  struct task_set *new_ts, *best_ts;
-  int i;
-  int last_improvement = 0;
-  int total_improvements = 0;
+  struct assignment_moves m;
+  struct search_neighbourhood nb;
+  struct search_objective obj;
+  struct search s;
+  struct task_set *ts;
   int preemptible = -1;
 
   assert (ANNEAL_MAX != -1);
@@ -516,155 +740,503 @@ struct task_set *maximize_insensitivity_by_annealing (struct task_set *orig_ts,
     }
   }
 
-  best_bd = find_critical_scale (orig_ts, NULL);
-  best_ts = copy_task_set (orig_ts);
-  free_task_set (orig_ts);
+  m.PT = PT;
+  m.target_pt_support = target_pt_support;
+  m.preemptible = preemptible;
+  init_assignment_neighbourhood (&nb, &m);
 
-  i = 0;
-  while (i < last_improvement + ANNEAL_MAX) {
+  obj.start = scale_start;
+  obj.cost = insensitivity_cost;
+  obj.settle = NULL;
+  obj.finish = NULL;
+  obj.slack = scale_slack;
+  obj.goal = -HUGE_VAL;
+  obj.arg = NULL;
 
-    new_ts = copy_task_set (best_ts);
-    if (PT) {
-      if (target_pt_support) {
-	permute_pri_and_thresh (new_ts);
-	respect_constraints_randomly (new_ts);
-      } else {
-	permute_npt (new_ts);
-      }
-    } else {
-      permute_pri (new_ts);
-      if (preemptible) {
-	make_all_preemptible (new_ts);
-      } else {
-	make_all_nonpreemptible (new_ts);
-      }
-    }
-    
-    if (i%100 == 0) {
-      DBGPrint (3, ("  anneal rep %d; best is %f; temp is %f\n", 
-		    i, best_bd, temp));
-    }
+  s.obj = &obj;
+  s.moves = &nb;
+  s.strategy = SEARCH_STRATEGY;
+  s.patience = ANNEAL_MAX;
 
-    if (feasible (new_ts, FALSE) == new_ts->num_tasks) {
+  ts = orig_ts;
+  search_with_replicas (&ts, &s);
 
-      if (test_critical_scale (new_ts, best_bd) ||
-	  (rand_double() < temp &&
-	   test_critical_scale (new_ts, (1+((best_bd-1.0)/2))))) {
-	new_bd = find_critical_scale (new_ts, NULL);
-	if (new_bd > best_bd) {
-	  last_improvement = i;
-	  total_improvements++;
-	}
-	assert (new_bd >= 1.0);
-	best_bd = new_bd;
-	free_task_set (best_ts);
-	best_ts = copy_task_set (new_ts);
-      }
-    }
-    
-    free_task_set (new_ts);
-    temp *= TEMP_SCALE;
-    i++;
-    
+  // R and S still describe the last move tried
+  feasible (ts, TRUE);
+
+  return ts;
+}
+
+#ifdef USE_DVS
+/*
+ * Searching priorities, thresholds and frequency levels together for
+ * the least energy.  Half the random moves change an assignment and
+ * half step a frequency level.  Power is cheap to find and
+ * feasibility is not, so a move is analysed only if it would be cheap
+ * enough to take.
+ */
+static void joint_move (struct task_set *ts, void *arg)
+{
+  const struct search_neighbourhood *assign = 
+    (const struct search_neighbourhood *) arg;
+
+  if (rand_double() < 0.5) {
+    freq_step_move (ts, NULL);
+  } else {
+    assign->move (ts, assign->arg);
+  }
+}
+
+static int joint_size (struct task_set *ts, void *arg)
+{
+  const struct search_neighbourhood *assign = 
+    (const struct search_neighbourhood *) arg;
+
+  return assign->size (ts, assign->arg) + freq_step_size (ts, NULL);
+}
+
+static void joint_nth (struct task_set *ts, int k, void *arg)
+{
+  const struct search_neighbourhood *assign = 
+    (const struct search_neighbourhood *) arg;
+  int n = assign->size (ts, assign->arg);
+
+  if (k < n) {
+    assign->nth (ts, k, assign->arg);
+  } else {
+    freq_step_nth (ts, k - n, NULL);
+  }
+}
+
+static void *energy_start (struct task_set *ts, void *arg, double *cost)
+{
+  *cost = compute_average_power (ts, NULL);
+  return arg;
+}
+
+static double energy_cost (struct task_set *ts, void *state, double bound)
+{
+  double p = compute_average_power (ts, NULL);
+
+  if (p > bound) return HUGE_VAL;
+  if (feasible (ts, FALSE) != ts->num_tasks) return HUGE_VAL;
+  return p;
+}
+
+struct task_set *minimize_energy_by_annealing (struct task_set *ts,
+					       double *scale)
+{
+  struct assignment_moves m;
+  struct search_neighbourhood assign, nb;
+  struct search_objective obj;
+  struct search s;
+  double power;
+  int feas;
+
+  assert (ANNEAL_MAX != -1);
+
+  assert (ts);
+  assert (uses_preempt_thresh_analysis (ts));
+  assert (ts->Analysis.valid (ts));
+  assert (feasible (ts, FALSE) == ts->num_tasks);
+
+  m.PT = TRUE;
+  m.target_pt_support = TRUE;
+  m.preemptible = -1;
+  init_assignment_neighbourhood (&assign, &m);
+
+  nb.move = joint_move;
+  nb.size = joint_size;
+  nb.nth = joint_nth;
+  nb.arg = &assign;
+
+  obj.start = energy_start;
+  obj.cost = energy_cost;
+  obj.settle = NULL;
+  obj.finish = NULL;
+  obj.slack = NULL;
+  obj.goal = -HUGE_VAL;
+  obj.arg = NULL;
+
+  s.obj = &obj;
+  s.moves = &nb;
+  s.strategy = SEARCH_STRATEGY;
+  s.patience = ANNEAL_MAX;
+
+  power = search_with_replicas (&ts, &s);
+
+  DBGPrint (3, ("minimize_energy_by_annealing: average power %f\n", power));
+
+  // R and S still describe the last move tried
+  feas = feasible (ts, TRUE);
+  assert (feas == ts->num_tasks);
+
+  if (scale) {
+    *scale = find_critical_scale (ts, NULL);
   }
 
-  DBGPrint (3, ("  tested %d;  final temp is %f; last imp. at %d, total imp. %d\n", 
-		i, temp, last_improvement, total_improvements));
+  return ts;
+}
+#endif
 
-  return best_ts;
+static double counted_scale_cost (struct task_set *ts, void *state,
+				  double bound)
+{
+  (*(int *) state)++;
+  return scale_cost (ts, state, bound);
 }
 
+/*
+ * random descent on the critical scaling factor of an all-preemptible
+ * or all-nonpreemptible set, until 20000 moves in a row fail to
+ * improve it
+ */
 struct task_set *greedy (struct task_set *ts)
 {
-  double best_bd, new_bd;
-  struct task_set *best_ts, *new_ts;
-  int count = 0;
+  struct assignment_moves m;
+  struct search_neighbourhood nb;
+  struct search_objective obj;
+  struct search s;
   int tested = 0;
 
-  best_bd = find_critical_scale (ts, NULL);
-  best_ts = copy_task_set (ts);
-  free_task_set (ts);
+  assert (is_all_preemptible (ts) || is_all_nonpreemptible (ts));
 
-  do {
+  m.PT = FALSE;
+  m.target_pt_support = FALSE;
+  m.preemptible = is_all_preemptible (ts);
+  init_assignment_neighbourhood (&nb, &m);
 
-    new_ts = copy_task_set (best_ts);
-    permute_pri (new_ts);
-    new_bd = find_critical_scale (new_ts, NULL);
-    count++;
-    tested++;
-
-    if (new_bd > best_bd) {
-      best_bd = new_bd;
-      free_task_set (best_ts);
-      best_ts = copy_task_set (new_ts);
-      count = 0;
-    }
-    
-    free_task_set (new_ts);
+  obj.start = scale_start;
+  obj.cost = counted_scale_cost;
+  obj.settle = NULL;
+  obj.finish = NULL;
+  obj.slack = NULL;
+  obj.goal = -HUGE_VAL;
+  obj.arg = &tested;
 
-  } while (count < 20000);
+  s.obj = &obj;
+  s.moves = &nb;
+  s.strategy = SEARCH_DESCENT;
+  s.patience = 20000;
+
+  local_search (ts, &s);
 
   printf ("tested %d\n", tested);
   
-  return best_ts;
+  return ts;
 }
 
-static int total;
-static double best_bd;
-static struct task_set *best_ts;
+/*
+ * Exhaustive search over priority orderings by branch and bound.
+ * Priorities are handed out from the lowest level upward, and a task's
+ * response time depends only on which tasks are above it, not on how
+ * they are ordered, so once a task is placed its fate is sealed for the
+ * whole subtree.  If it misses its deadline with every C scaled by the
+ * best factor found so far, no completion can beat that factor and the
+ * subtree is dropped.  The same holds if the levels above it cannot be
+ * filled, which Audsley's algorithm settles in quadratic time.
+ *
+ * Testing at the top of the bracket the incumbent's bisection ended in,
+ * rather than at the incumbent itself, also drops subtrees that could
+ * only tie it.  The subtrees rooted at the two lowest levels are handed
+ * out in order to EXHAUSTIVE_THREADS workers from a shared queue, and a
+ * tie goes to the earlier subtree, so the answer is the one a single
+ * thread would find.
+ */
+
+int EXHAUSTIVE_THREADS = 1;
+
+struct bnb_search {
+  time_value *Corig;
+  int *order;             // deadline-monotonic order to start from
+  int preemptible;
+  int items;
+  int next;               // next subtree to hand out
+  pthread_mutex_t lock;
+  double best_bd;
+  double best_above;      // least factor that would beat best_bd
+  int best_item;          // subtree best_ts came from
+  struct task_set *best_ts;
+};
+
+struct bnb_worker {
+  struct bnb_search *s;
+  struct task_set *ts;
+  int *order;             // order[k] is the task at level k
+  int *saved;
+  int item;               // subtree being searched
+  double bound;           // ts->tasks[].C are scaled by this
+  int dead;               // back up to this level, or -1
+  int tested;
+};
+
+static void bnb_rescale (struct bnb_worker *w)
+{
+  int i;
+
+  for (i=0; i<w->ts->num_tasks; i++) {
+    w->ts->tasks[i].C = (time_value) (w->s->Corig[i] * w->bound);
+  }
+}
 
-static void test (struct task_set *ts)
+/*
+ * scale to beat: ties with a later subtree are worth finding, ties with
+ * an earlier one are not
+ */
+static void bnb_refresh (struct bnb_worker *w)
 {
-  double new_bd;
+  double bd;
 
-  new_bd = find_critical_scale (ts, NULL);
-  if (new_bd > best_bd) {
-    best_bd = new_bd;
-    if (best_ts) {
-      free_task_set (best_ts);
+  pthread_mutex_lock (&w->s->lock);
+  bd = (w->s->best_item <= w->item) ? w->s->best_above : w->s->best_bd;
+  pthread_mutex_unlock (&w->s->lock);
+
+  if (bd != w->bound) {
+    w->bound = bd;
+    bnb_rescale (w);
+  }
+}
+
+static void bnb_set_level (struct bnb_worker *w, int k)
+{
+  struct task *t = &w->ts->tasks[w->order[k]];
+
+  t->P = k;
+  if (w->s->preemptible) t->PT = k;
+}
+
+/*
+ * swap the tasks at levels j and k; doing it twice puts them back
+ */
+static void bnb_swap (struct bnb_worker *w, int j, int k)
+{
+  int tmp = w->order[j];
+
+  w->order[j] = w->order[k];
+  w->order[k] = tmp;
+  bnb_set_level (w, j);
+  bnb_set_level (w, k);
+}
+
+/*
+ * the bound has moved past the checks made on the way down; find the
+ * lowest level whose task no longer makes it
+ */
+static void bnb_find_dead (struct bnb_worker *w)
+{
+  int k;
+
+  feasible (w->ts, TRUE);
+  for (k=w->ts->num_tasks-1; k>=0; k--) {
+    if (!w->ts->tasks[w->order[k]].S) {
+      w->dead = k;
+      return;
     }
-    best_ts = copy_task_set (ts);
   }
 }
 
-static void pick_pri (struct task_set *ts, 
-		      int t)
+static void bnb_leaf (struct bnb_worker *w)
 {
-  int i, pri;
-  int n = ts->num_tasks;
+  struct bnb_search *s = w->s;
+  double new_bd, above;
+  int i;
+
+  w->tested++;
+  bnb_refresh (w);
+
+  if (feasible (w->ts, FALSE) != w->ts->num_tasks) {
+    bnb_find_dead (w);
+    return;
+  }
+
+  for (i=0; i<w->ts->num_tasks; i++) {
+    w->ts->tasks[i].C = s->Corig[i];
+  }
+  new_bd = critical_scale (w->ts, NULL, &above);
+
+  pthread_mutex_lock (&s->lock);
+  if (new_bd > s->best_bd ||
+      (new_bd == s->best_bd && w->item < s->best_item)) {
+    s->best_bd = new_bd;
+    s->best_above = above;
+    s->best_item = w->item;
+    free_task_set (s->best_ts);
+    s->best_ts = copy_task_set (w->ts);
+  }
+  pthread_mutex_unlock (&s->lock);
+
+  bnb_rescale (w);
+  bnb_refresh (w);
+  bnb_find_dead (w);
+}
+
+/*
+ * can the levels above k be filled at all?  Audsley's greedy assignment
+ * answers that exactly, since a task that fits at some level also fits
+ * at every level above it
+ */
+static int bnb_completes (struct bnb_worker *w, int k)
+{
+  int l, j, ok = TRUE;
 
-  for (pri = 0; pri < n; pri++) {
-    
-    // bail if collision with a lower-numbered task
-    for (i=0; i<t; i++) {
-      if (ts->tasks[i].P == pri) goto loop_end;
+  memcpy (w->saved, w->order, k * sizeof (int));
+
+  for (l=k-1; l>=0 && ok; l--) {
+    ok = FALSE;
+    for (j=l; j>=0; j--) {
+      bnb_swap (w, j, l);
+      if (feasible_one_task (w->ts, w->order[l])) {
+	ok = TRUE;
+	break;
+      }
+      bnb_swap (w, j, l);
     }
-    
-    // no collision, so assign priority
-    ts->tasks[t].P = pri;
-
-    if (t == n-1) {
-      // all priorities assigned
-      total++;
-      test (ts);
-    } else {
-      // still more tasks to go
-      pick_pri (ts, t+1);
-    } 
-  loop_end:
-    ;
   }
+
+  memcpy (w->order, w->saved, k * sizeof (int));
+  for (l=0; l<k; l++) {
+    bnb_set_level (w, l);
+  }
+
+  return ok;
+}
+
+/*
+ * the task at level k has just been placed; is it still in the running?
+ */
+static int bnb_fits (struct bnb_worker *w, int k)
+{
+  return feasible_one_task (w->ts, w->order[k]) && bnb_completes (w, k);
+}
+
+/*
+ * levels above k are all taken; try each remaining task at level k
+ */
+static void bnb_descend (struct bnb_worker *w, int k)
+{
+  int j;
+
+  if (k < 0) {
+    bnb_leaf (w);
+    return;
+  }
+
+  // deadline-monotonic candidates first, to raise the bound early
+  for (j=k; j>=0; j--) {
+    bnb_swap (w, j, k);
+    if (bnb_fits (w, k)) {
+      bnb_descend (w, k-1);
+    }
+    bnb_swap (w, j, k);
+    if (w->dead > k) return;
+    if (w->dead == k) w->dead = -1;
+  }
+}
+
+static void *bnb_worker_main (void *arg)
+{
+  struct bnb_worker *w = (struct bnb_worker *) arg;
+  struct bnb_search *s = w->s;
+  int n = w->ts->num_tasks;
+  int item, i;
+
+  while ((item = __sync_fetch_and_add (&s->next, 1)) < s->items) {
+    w->item = item;
+    w->dead = -1;
+    for (i=0; i<n; i++) {
+      w->order[i] = s->order[i];
+      bnb_set_level (w, i);
+    }
+    bnb_refresh (w);
+
+    if (n < 2) {
+      bnb_descend (w, n-1);
+      continue;
+    }
+
+    // subtree item fixes the two lowest levels
+    bnb_swap (w, n-1 - item / (n-1), n-1);
+    if (!bnb_fits (w, n-1)) continue;
+    bnb_swap (w, n-2 - item % (n-1), n-2);
+    if (!bnb_fits (w, n-2)) continue;
+    bnb_descend (w, n-3);
+  }
+
+  return NULL;
 }
 
 struct task_set *exhaustive (struct task_set *ts)
 {
+  struct bnb_search s;
+  struct bnb_worker *workers;
+  int n = ts->num_tasks;
+  int nthreads = EXHAUSTIVE_THREADS;
+  int i, j, total;
+
+  assert (ts->Analysis.valid (ts));
+  // with thresholds of their own, the tasks above a level would matter
+  // in order and not just as a set
+  assert (is_all_preemptible (ts) || is_all_nonpreemptible (ts));
+  assert (nthreads > 0);
+
+  s.preemptible = is_all_preemptible (ts);
+  s.items = (n < 2) ? 1 : n * (n-1);
+  s.next = 0;
+  pthread_mutex_init (&s.lock, NULL);
+
+  s.Corig = (time_value *) xmalloc (n * sizeof (time_value));
+  s.order = (int *) xmalloc (n * sizeof (int));
+  for (i=0; i<n; i++) {
+    s.Corig[i] = ts->tasks[i].C;
+    // insertion sort by deadline
+    for (j=i; j>0 && ts->tasks[s.order[j-1]].D > ts->tasks[i].D; j--) {
+      s.order[j] = s.order[j-1];
+    }
+    s.order[j] = i;
+  }
+
+  // the deadline-monotonic ordering is the first incumbent
+  for (i=0; i<n; i++) {
+    ts->tasks[s.order[i]].P = i;
+    if (s.preemptible) ts->tasks[s.order[i]].PT = i;
+  }
+  s.best_bd = critical_scale (ts, NULL, &s.best_above);
+  s.best_item = -1;
+  s.best_ts = copy_task_set (ts);
+
+  workers = (struct bnb_worker *) xmalloc (nthreads * sizeof (struct bnb_worker));
+  for (i=0; i<nthreads; i++) {
+    workers[i].s = &s;
+    workers[i].ts = copy_task_set (ts);
+    workers[i].order = (int *) xmalloc (n * sizeof (int));
+    workers[i].saved = (int *) xmalloc (n * sizeof (int));
+    workers[i].bound = 0;
+    workers[i].tested = 0;
+  }
+
+  run_on_threads (nthreads, bnb_worker_main, workers,
+		  sizeof (struct bnb_worker), NULL);
+
   total = 0;
-  best_bd = -1;
-  best_ts = NULL;
-  pick_pri (ts, 0);
+  for (i=0; i<nthreads; i++) {
+    total += workers[i].tested;
+    free_task_set (workers[i].ts);
+    xfree (workers[i].order);
+    xfree (workers[i].saved);
+  }
+
+  xfree (workers);
+  xfree (s.order);
+  xfree (s.Corig);
+  pthread_mutex_destroy (&s.lock);
   free_task_set (ts);
+
   printf ("tested %d\n", total);
-  return best_ts;
+
+  // R and S are left over from the search
+  feasible (s.best_ts, TRUE);
+
+  return s.best_ts;
 }
 
 #ifdef XMALLOC_CNT
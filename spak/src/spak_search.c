@@ -0,0 +1,386 @@
+/*
+ * Copyright (c) 2002 University of Utah and the Flux Group.
+ * All rights reserved.
+ *
+ * This file is part of SPAK.
+ *
+ * Permission to use, copy, modify, distribute, and sell this software
+ * and its documentation is hereby granted without fee, provided that the
+ * above copyright notice and this permission/disclaimer notice is
+ * retained in all copies or modified versions, and that both notices
+ * appear in supporting documentation.  THE COPYRIGHT HOLDERS PROVIDE
+ * THIS SOFTWARE "AS IS" AND WITHOUT ANY EXPRESS OR IMPLIED WARRANTIES,
+ * INCLUDING, WITHOUT LIMITATION, THE IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE.  THE COPYRIGHT
+ * HOLDERS DISCLAIM ANY LIABILITY OF ANY KIND FOR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM THE USE OF THIS SOFTWARE.
+ *
+ * Users are requested, but not required, to send to csl-dist@cs.utah.edu
+ * any improvements that they make and grant redistribution rights to the
+ * University of Utah.
+ *
+ * Author: John Regehr (regehr@cs.utah.edu)
+ */
+
+/*
+ * Local search over the assignments of a task set.  A search pairs an
+ * objective with a neighbourhood and works on the task set in place:
+ * every move goes into the task set's undo log, so a rejected move is
+ * rolled back rather than a copy being thrown away.
+ */
+
+#include "spak_public.h"
+#include "spak_internal.h"
+#include <math.h>
+
+#define DBG_LEVEL 0
+
+int SEARCH_STRATEGY = SEARCH_ANNEAL;
+int TABU_TENURE = 7;
+
+/*
+ * the best assignment seen, kept once the search has moved away from
+ * it so that it can be put back at the end
+ */
+struct snapshot {
+  int *P, *PT, *merge;
+#ifdef USE_DVS
+  freq_level *f;
+  time_value *C;
+#endif
+};
+
+static void init_snapshot (struct snapshot *b, struct task_set *ts)
+{
+  b->P = (int *) xmalloc (ts->num_tasks * sizeof (int));
+  b->PT = (int *) xmalloc (ts->num_tasks * sizeof (int));
+  b->merge = (int *) xmalloc ((ts->num_task_clusters+1) * sizeof (int));
+#ifdef USE_DVS
+  b->f = (freq_level *) xmalloc (ts->num_tasks * sizeof (freq_level));
+  b->C = (time_value *) xmalloc (ts->num_tasks * sizeof (time_value));
+#endif
+}
+
+static void free_snapshot (struct snapshot *b)
+{
+  xfree (b->P);
+  xfree (b->PT);
+  xfree (b->merge);
+#ifdef USE_DVS
+  xfree (b->f);
+  xfree (b->C);
+#endif
+}
+
+/*
+ * record the assignment ts had before the move in its undo log
+ */
+static void take_snapshot (struct snapshot *b, struct task_set *ts)
+{
+  struct undo_log *u = ts->undo;
+  int i;
+
+  for (i=0; i<ts->num_tasks; i++) {
+    b->P[i] = ts->tasks[i].P;
+    b->PT[i] = ts->tasks[i].PT;
+#ifdef USE_DVS
+    b->f[i] = ts->tasks[i].f;
+    b->C[i] = ts->tasks[i].C;
+#endif
+  }
+  for (i=0; i<ts->num_task_clusters; i++) {
+    b->merge[i] = ts->task_clusters[i].merge;
+  }
+
+  for (i=0; i<u->num_entries; i++) {
+    struct undo_entry *e = &u->entries[i];
+    if (e->what >= 0) {
+      b->P[e->what] = e->P;
+      b->PT[e->what] = e->PT;
+#ifdef USE_DVS
+      b->f[e->what] = e->f;
+      b->C[e->what] = e->C;
+#endif
+    } else {
+      b->merge[-1-e->what] = e->P;
+    }
+  }
+}
+
+static void restore_snapshot (struct snapshot *b, struct task_set *ts)
+{
+  int i;
+
+  for (i=0; i<ts->num_tasks; i++) {
+    ts->tasks[i].P = b->P[i];
+    ts->tasks[i].PT = b->PT[i];
+#ifdef USE_DVS
+    ts->tasks[i].f = b->f[i];
+    ts->tasks[i].C = b->C[i];
+#endif
+  }
+  for (i=0; i<ts->num_task_clusters; i++) {
+    ts->task_clusters[i].merge = b->merge[i];
+  }
+}
+
+/*
+ * state shared by the strategies
+ */
+struct walk {
+  struct task_set *ts;
+  const struct search *s;
+  void *state;
+  double cost;            // of ts as it stands
+  double best;
+  int at_best;            // if not, the best assignment is in snap
+  struct snapshot snap;
+};
+
+/*
+ * take the move in ts's undo log, after which ts costs c; returns
+ * whether that is a new best
+ */
+static int take_move (struct walk *w, double c)
+{
+  int better = (c < w->best);
+
+  if (better) {
+    w->best = c;
+    w->at_best = TRUE;
+  } else if (c > w->best && w->at_best) {
+    take_snapshot (&w->snap, w->ts);
+    w->at_best = FALSE;
+  }
+  w->cost = c;
+  keep_changes (w->ts);
+  if (w->s->obj->settle) w->s->obj->settle (w->state, TRUE);
+
+  return better;
+}
+
+static void reject_move (struct walk *w)
+{
+  undo_changes (w->ts);
+  if (w->s->obj->settle) w->s->obj->settle (w->state, FALSE);
+}
+
+/*
+ * Annealing as the annealers have always done it: a worse move is
+ * taken with probability temp, which starts at INIT_TEMP and shrinks
+ * by TEMP_SCALE every step.  Deciding that before the move is
+ * evaluated lets the objective give up early on moves that will be
+ * rejected anyway.  Patience runs from the last step that lowered the
+ * current cost, whether or not it was a new best.  With no temperature
+ * this is a random descent.
+ */
+static void anneal (struct walk *w, double temp)
+{
+  const struct search_objective *obj = w->s->obj;
+  const struct search_neighbourhood *nb = w->s->moves;
+  int i, last_improvement;
+
+  i = last_improvement = 0;
+  while (i < last_improvement + w->s->patience && w->best > obj->goal) {
+    double bound, c;
+
+    nb->move (w->ts, nb->arg);
+
+    bound = w->cost;
+    if (temp > 0 && rand_double() < temp) {
+      bound = obj->slack ? obj->slack (w->state, w->cost) : HUGE_VAL;
+    }
+    c = obj->cost (w->ts, w->state, bound);
+
+    if (i%100 == 0) {
+      DBGPrint (3, ("  step %d: best %f, current %f, temp %f\n",
+		    i, w->best, w->cost, temp));
+    }
+
+    if (c <= bound && c != HUGE_VAL) {
+      if (c < w->cost) last_improvement = i;
+      take_move (w, c);
+    } else {
+      reject_move (w);
+    }
+
+    temp *= TEMP_SCALE;
+    i++;
+  }
+
+  DBGPrint (3, ("  searched %d steps, last improvement at %d\n",
+		i, last_improvement));
+}
+
+/*
+ * Evaluate every neighbour of ts and return the one to move to, or -1.
+ * Steepest descent wants the best neighbour that beats the current
+ * cost.  Tabu search wants the best neighbour at any cost, skipping
+ * ones that change a task or cluster still in tabu[] unless they beat
+ * the best cost seen.  The objective can stop early on anything worse
+ * than what is already in hand.
+ */
+static int best_neighbour (struct walk *w, int *tabu, int step, double *cost)
+{
+  const struct search_objective *obj = w->s->obj;
+  const struct search_neighbourhood *nb = w->s->moves;
+  struct task_set *ts = w->ts;
+  int k, size, pick = -1;
+  double pick_cost;
+
+  size = nb->size (ts, nb->arg);
+  pick_cost = tabu ? HUGE_VAL : w->cost;
+
+  for (k=0; k<size; k++) {
+    struct undo_log *u = ts->undo;
+    double bound, c;
+    int i, forbidden = FALSE;
+
+    nb->nth (ts, k, nb->arg);
+    if (u->num_entries == 0) continue;
+
+    if (tabu) {
+      for (i=0; i<u->num_entries; i++) {
+	int x = u->entries[i].what;
+	if (tabu[(x >= 0) ? x : ts->max_tasks-1-x] > step) forbidden = TRUE;
+      }
+    }
+
+    bound = pick_cost;
+    if (forbidden && w->best < bound) bound = w->best;
+    c = obj->cost (ts, w->state, bound);
+    if (c != HUGE_VAL &&
+	(pick == -1 ? c <= pick_cost : c < pick_cost) &&
+	(!forbidden || c < w->best) &&
+	(tabu || c < w->cost)) {
+      pick = k;
+      pick_cost = c;
+    }
+    reject_move (w);
+  }
+
+  *cost = pick_cost;
+  return pick;
+}
+
+/*
+ * move to the best neighbour until none is better than where we are
+ */
+static void steepest (struct walk *w)
+{
+  const struct search_neighbourhood *nb = w->s->moves;
+  int k, steps = 0;
+  double c;
+
+  while (w->best > w->s->obj->goal &&
+	 (k = best_neighbour (w, NULL, 0, &c)) != -1) {
+    nb->nth (w->ts, k, nb->arg);
+    c = w->s->obj->cost (w->ts, w->state, c);
+    take_move (w, c);
+    steps++;
+  }
+
+  DBGPrint (3, ("  %d steps of steepest descent\n", steps));
+}
+
+static void tabu_search (struct walk *w)
+{
+  const struct search_neighbourhood *nb = w->s->moves;
+  struct task_set *ts = w->ts;
+  int *tabu;
+  int i, k, step, last_improvement;
+  int n = ts->max_tasks + ts->max_task_clusters;
+  double c;
+
+  tabu = (int *) xmalloc (n * sizeof (int));
+  for (i=0; i<n; i++) {
+    tabu[i] = 0;
+  }
+
+  step = last_improvement = 0;
+  while (step < last_improvement + w->s->patience && 
+	 w->best > w->s->obj->goal &&
+	 (k = best_neighbour (w, tabu, step, &c)) != -1) {
+    struct undo_log *u = ts->undo;
+
+    nb->nth (ts, k, nb->arg);
+    for (i=0; i<u->num_entries; i++) {
+      int x = u->entries[i].what;
+      tabu[(x >= 0) ? x : ts->max_tasks-1-x] = step + 1 + TABU_TENURE;
+    }
+    c = w->s->obj->cost (ts, w->state, c);
+    if (take_move (w, c)) last_improvement = step;
+    step++;
+  }
+
+  DBGPrint (3, ("  %d steps of tabu search, last improvement at %d\n",
+		step, last_improvement));
+
+  xfree (tabu);
+}
+
+/*
+ * Search from the assignment in ts with the strategy s asks for,
+ * leaving ts at the best assignment seen, and return its cost.  Only
+ * priorities, thresholds, cluster merge flags and frequency levels are
+ * put back, so R and S may describe some other assignment.  The
+ * objective's state is handed back in *state rather than finished, so
+ * that searches on several threads can be finished on one.
+ */
+double local_search_unfinished (struct task_set *ts, const struct search *s,
+				void **state)
+{
+  const struct search_objective *obj = s->obj;
+  struct walk w;
+
+  assert (ts);
+  assert (s->obj && s->moves);
+  assert (s->patience > 0);
+  assert (s->strategy == SEARCH_ANNEAL || s->strategy == SEARCH_DESCENT ||
+	  s->moves->size);
+
+  w.ts = ts;
+  w.s = s;
+  init_snapshot (&w.snap, ts);
+
+  start_undo_log (ts);
+  w.state = obj->start (ts, obj->arg, &w.cost);
+  keep_changes (ts);
+  w.best = w.cost;
+  w.at_best = TRUE;
+
+  switch (s->strategy) {
+  case SEARCH_ANNEAL:
+    anneal (&w, INIT_TEMP);
+    break;
+  case SEARCH_DESCENT:
+    anneal (&w, 0);
+    break;
+  case SEARCH_STEEPEST:
+    steepest (&w);
+    break;
+  case SEARCH_TABU:
+    tabu_search (&w);
+    break;
+  default:
+    assert (0);
+  }
+
+  stop_undo_log (ts);
+  if (!w.at_best) restore_snapshot (&w.snap, ts);
+  free_snapshot (&w.snap);
+
+  *state = w.state;
+  return w.best;
+}
+
+double local_search (struct task_set *ts, const struct search *s)
+{
+  void *state;
+  double cost;
+
+  cost = local_search_unfinished (ts, s, &state);
+  if (s->obj->finish) s->obj->finish (state, s->obj->arg);
+
+  return cost;
+}
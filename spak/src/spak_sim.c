@@ -41,54 +41,133 @@ static int total_misses, total_hits;
 #ifdef USE_DVS
 static energy_value energy_sum;
 static power_value  power;
-#define idle_f_level   (MIN_FREQ_LEVEL)
 #endif
-#ifdef USE_COUNT_DISPATCH
 static int dispatch_count = 0;
+static int switch_count;
+
+/*
+ * Switching overheads.  Each dispatch costs SIM_SWITCH_TIME, and each
+ * change of level between one stretch of execution and the next costs
+ * SIM_FREQ_SWITCH_TIME; the time is added to the job being switched
+ * to, so it delays the schedule and is charged at that job's level.
+ * The energy penalties come on top of that.
+ */
+time_value SIM_SWITCH_TIME = 0;
+#ifdef USE_DVS
+energy_value SIM_SWITCH_ENERGY = 0;
+time_value SIM_FREQ_SWITCH_TIME = 0;
+energy_value SIM_FREQ_SWITCH_ENERGY = 0;
+
+static int freq_switch_count;
+static freq_level last_level;   // of the last stretch of execution; -1 before any
 #endif
 
+FILE* SIM_SUMMARY_FP = NULL;
+
+int SIM_MAX_MISSES = 0;
+
+static time_value first_miss_time;
+static int first_miss_task;
+
+/*
+ * per-task statistics beyond the maximum response time
+ */
+struct task_stats {
+    struct spak_hist resp;
+    time_value max_lateness;
+    int late;
+    int preemptions;
+    int switches;        // times dispatched
+    int freq_switches;   // times dispatched or rescaled onto a new level
+};
+
+static struct task_stats* task_stats;
+
+/*
+ * the per-task counters of the most recent simulation
+ */
+struct task_counters {
+    int preemptions;
+    int switches;
+    int freq_switches;
+};
+
+static struct task_counters* last_counters;
+static int last_counters_max;
+
 enum event_type {
-    ARRIVE = 8122,
-    EXPIRATION,
-    RELEASE,
-    DEADLINE
+    TASK_EVENT = 8122,
+    EXPIRATION
 };
 
+/*
+ * every task has exactly one event in the queue, keyed by the next
+ * time something happens to it: an arrival, the release of a jittered
+ * job, or (only when deadlines are checked eagerly) a deadline; all
+ * expirations share one event
+ */
 struct event {
     enum event_type type;
     struct task* task;
-    struct task_instance* inst;
 };
 
+/*
+ * a job, from its arrival until it completes; jobs that have arrived
+ * but are not yet running wait, in order, on their task's next_inst
+ * list
+ */
 struct task_instance {
     time_value arrival;
-    int deferred;
-    int completed;
+    time_value release;
+    time_value deadline;
+    time_value exec;     // execution time at the task's static level
     int missed;
     struct task_instance* next;
 };
 
-static struct event* new_event (enum event_type type)
-{
-    struct event* e = (struct event*) xmalloc (sizeof (struct event));
-    e->type = type;
-    return e;
-}
+static struct event* task_events;
+static struct event expiration_event = { EXPIRATION, NULL };
+static time_value expiration_time;
+
+/*
+ * normally a deadline is checked when its job completes (or when the
+ * simulation ends); tracing needs misses reported as they happen
+ */
+static int eager_deadlines;
 
 static void insert_event (struct event* e, time_value t)
 {
     pri_q_insert (t, (void*)e);
 }
 
+/*
+ * once SIM_MAX_MISSES misses have been counted the simulation stops
+ * and further misses are ignored
+ */
+static void count_miss (struct task* t, struct task_instance* ti)
+{
+    if (SIM_MAX_MISSES && total_misses >= SIM_MAX_MISSES) return;
+
+    if (total_misses == 0) {
+        first_miss_time = ti->deadline;
+        first_miss_task = t - sim_ts->tasks;
+    }
+    total_misses++;
+
+    if (SIM_MAX_MISSES && total_misses >= SIM_MAX_MISSES) {
+        sim_finished = TRUE;
+    }
+}
+
 static void record_runtime (struct task* t)
 {
-    freq_scale freq = 0;
     if (last_record != sim_time) {
         const char* c = (t) ? t->name : "idle";
 
 #ifdef USE_DVS
-        freq = (t)? valid_f_scale[t->f]: valid_f_scale[idle_f_level];
-        energy_sum += 1.0*(sim_time-last_record)*pow(freq, 3.0);
+        power_value p = (t) ? dvfs_level_power (sim_ts->profile, t->run_f) :
+                        sim_ts->profile->idle_power;
+        energy_sum += 1.0*(sim_time-last_record)*p;
 #endif
         DBGPrint (5, ("%d -- %d : %s\n",
                       last_record, sim_time, c));
@@ -98,15 +177,32 @@ static void record_runtime (struct task* t)
     last_record = sim_time;
 }
 
+/*
+ * the running job spends time on an overhead before continuing
+ */
+static void charge_overhead (struct task* t, time_value time)
+{
+    if (time <= 0) return;
+
+    t->budget += time;
+#ifdef USE_DVS
+    t->work += time * sim_ts->profile->levels[t->run_f].f;
+    t->wc_work += time * sim_ts->profile->levels[t->run_f].f;
+#endif
+    if (t == current) {
+        expiration_time = sim_time + t->budget;
+        insert_event (&expiration_event, expiration_time);
+    }
+}
+
 /*
  * make next_task start running
  */
 static void dispatch (struct task* next_task)
 {
-    struct event* e;
-
     if (current) {
         current->state = READY;
+        task_stats[current - sim_ts->tasks].preemptions++;
     }
 
     DBGPrint (5, ("current was %s (effP = %d), is now %s (effP = %d)\n",
@@ -114,54 +210,131 @@ static void dispatch (struct task* next_task)
                   (current) ? current->effP : -1,
                   next_task->name,
                   next_task->effP));
-#ifdef USE_COUNT_DISPATCH
-    dispatch_count += (current) ? 1 : 0,
-#endif
-                      record_runtime (current);
+    dispatch_count += (current) ? 1 : 0;
+    record_runtime (current);
     current = next_task;
     current->state = RUNNING;
     current->last_scheduled = sim_time;
 
-    e = new_event (EXPIRATION);
-    insert_event (e, sim_time + current->budget);
+    expiration_time = sim_time + current->budget;
+    insert_event (&expiration_event, expiration_time);
+
+    switch_count++;
+    task_stats[current - sim_ts->tasks].switches++;
+    charge_overhead (current, SIM_SWITCH_TIME);
+#ifdef USE_DVS
+    energy_sum += SIM_SWITCH_ENERGY;
+#endif
 }
 
-static struct task_instance* new_task_instance (void)
+#ifdef USE_DVS
+const struct sim_dvs_policy* SIM_DVS_POLICY = NULL;
+
+static inline freq_scale level_scale (freq_level f)
 {
-    struct task_instance* ti;
+    return sim_ts->profile->levels[f].f;
+}
 
-    ti = (struct task_instance*) xmalloc (sizeof (struct task_instance));
-    ti->arrival = sim_time;
-    ti->completed = FALSE;
-    ti->missed = FALSE;
-    ti->deferred = FALSE;
-    ti->next = NULL;
+/*
+ * run the current job at level f from now on; time run so far is
+ * charged at the old level
+ */
+static void set_run_level (struct task* t, freq_level f)
+{
+    if (f == t->run_f) return;
 
-    return ti;
+    assert (t == current);
+    record_runtime (t);
+    t->run_f = f;
+    t->budget = (time_value) ceil (t->work / level_scale (f) - 1e-9);
+    if (t->budget < 1) t->budget = 1;
+
+    expiration_time = sim_time + t->budget;
+    insert_event (&expiration_event, expiration_time);
+}
+
+/*
+ * charge a frequency switch if the running job is not at the level
+ * the processor last ran at
+ */
+static void note_level (struct task* t)
+{
+    if (last_level >= 0 && t->run_f != last_level) {
+        freq_switch_count++;
+        task_stats[t - sim_ts->tasks].freq_switches++;
+        charge_overhead (t, SIM_FREQ_SWITCH_TIME);
+        energy_sum += SIM_FREQ_SWITCH_ENERGY;
+    }
+    last_level = t->run_f;
+}
+#endif
+
+/*
+ * how long a job runs at its task's static level
+ */
+static time_value sample_exec (struct task* t)
+{
+    double frac;
+    time_value exec;
+
+    switch (t->aet) {
+        case AET_UNIFORM:
+            frac = t->aet_a + (t->aet_b - t->aet_a) * rand_double ();
+            break;
+
+        case AET_NORMAL: {
+            double u1 = rand_double ();
+            double u2 = rand_double ();
+            if (u1 <= 0.0) u1 = 1e-12;
+            frac = t->aet_a + t->aet_b * sqrt (-2.0 * log (u1)) * cos (2.0 * M_PI * u2);
+            break;
+        }
+
+        default:
+            return t->C;
+    }
+
+    if (frac > 1.0) frac = 1.0;
+    exec = (time_value) ceil (frac * t->C);
+    if (exec < 1) exec = 1;
+    return (exec < t->C) ? exec : t->C;
 }
 
 static void run_instance (struct task* t, struct task_instance* ti)
 {
     t->cur_inst = ti;
     // t->budget = t->C + (time_value)(OVERRUN_FRAC * t->C * rand_double());
-    t->budget = t->C + (time_value)(OVERRUN_FRAC * t->C);
+    t->budget = ti->exec + (time_value)(OVERRUN_FRAC * t->C);
     t->state = READY;
+#ifdef USE_DVS
+    // a task's just-completed job is still charged at its own level
+    if (t != current) t->run_f = t->f;
+    t->work = t->budget * level_scale (t->f);
+    t->wc_work = (t->C + (time_value)(OVERRUN_FRAC * t->C)) * level_scale (t->f);
+    if (SIM_DVS_POLICY && SIM_DVS_POLICY->release) {
+        SIM_DVS_POLICY->release (sim_ts, t - sim_ts->tasks);
+    }
+#endif
     if (outfile) fprintf (outfile, "release %s %d\n", t->name, sim_time);
 }
 
-static struct task_instance* get_deferred_instance (struct task* t)
+/*
+ * remove and return the oldest waiting job if it has been released
+ */
+static struct task_instance* get_released_instance (struct task* t)
 {
     struct task_instance* ti = t->next_inst;
 
-    if (!ti) return NULL;
+    if (!ti || ti->release > sim_time) return NULL;
 
     t->next_inst = t->next_inst->next;
     if (!t->next_inst) {
         t->last_inst = NULL;
     }
-
-    assert (ti->deferred);
-    ti->deferred = FALSE;
+    if (t->unreleased_inst == ti) {
+        t->unreleased_inst = ti->next;
+    }
+    ti->next = NULL;
 
     return ti;
 }
@@ -178,6 +351,10 @@ static void do_accounting (void)
     deduction = sim_time - last_reschedule;
     current->budget -= deduction;
     assert (current->budget >= 0);
+#ifdef USE_DVS
+    current->work -= deduction * level_scale (current->run_f);
+    current->wc_work -= deduction * level_scale (current->run_f);
+#endif
 
     /*
      * lazily set effective priority to be preemption threshold
@@ -192,29 +369,45 @@ static void do_accounting (void)
 
     if (current->budget == 0) {
         int response_time;
-        struct task_instance* ti;
+        struct task_instance* ti = current->cur_inst;
 
-        response_time = sim_time - current->cur_inst->arrival;
+        response_time = sim_time - ti->arrival;
 
-        if (current->cur_inst->missed) {
-            // deadline has already been missed -- we clean up this instance
+        if (ti->missed || sim_time > ti->deadline) {
             DBGPrint (5, ("time %d : %s expiring; DEADLINE MISSED; response time was %d\n",
                           sim_time, current->name, response_time));
             if (outfile) fprintf (outfile, "missed %s %d\n", current->name, sim_time);
-            xfree (current->cur_inst);
+            if (!ti->missed) count_miss (current, ti);
         }
         else {
-            // deadline not missed -- the deadline event handler will clean up the instance
             DBGPrint (5, ("time %d : %s expiring; response time was %d\n",
                           sim_time, current->name, response_time));
             if (outfile) fprintf (outfile, "completed %s %d\n", current->name, sim_time);
-            current->cur_inst->completed = TRUE;
+            total_hits++;
         }
+        xfree (ti);
         current->cur_inst = NULL;
+#ifdef USE_DVS
+        if (SIM_DVS_POLICY && SIM_DVS_POLICY->complete) {
+            double left = current->wc_work / level_scale (current->f);
+            SIM_DVS_POLICY->complete (sim_ts, current - sim_ts->tasks,
+                                      (left > 0) ? (time_value) floor (left + 1e-9) : 0);
+        }
+#endif
 
         // at expiration, effective priority drops to normal
         current->effP = current->P;
 
+        {
+            struct task_stats* st = &task_stats[current - sim_ts->tasks];
+            time_value lateness = response_time - current->D;
+            hist_record (&st->resp, response_time);
+            if (st->resp.count == 1 || lateness > st->max_lateness) {
+                st->max_lateness = lateness;
+            }
+            if (lateness > 0) st->late++;
+        }
+
 #if 1
         if (response_time >= current->max_response_time) {
             if (response_time == current->max_response_time) {
@@ -233,17 +426,18 @@ static void do_accounting (void)
         }
 #endif
 
-        ti = get_deferred_instance(current);
+        // a waiting job is considered by the reschedule that called us
+        ti = get_released_instance (current);
         if (ti) {
-            struct event* e;
             run_instance (current, ti);
-            e = new_event (EXPIRATION);
-            insert_event (e, sim_time);
         }
         else {
             current->state = EXPIRED;
         }
         record_runtime (current);
+#ifdef USE_DVS
+        current->run_f = current->f;
+#endif
         current = NULL;
     }
 }
@@ -315,31 +509,34 @@ static void reschedule (void)
         DBGPrint (5, ("reschedule: not dispatching any task\n"));
     }
 
+#ifdef USE_DVS
+    if (SIM_DVS_POLICY && current) {
+        set_run_level (current, SIM_DVS_POLICY->level (sim_ts, current - sim_ts->tasks));
+    }
+    if (current) {
+        note_level (current);
+    }
+#endif
+
     last_reschedule = sim_time;
 }
 
 static void arrive (struct task* t)
 {
     struct task_instance* ti;
-    ti = new_task_instance ();
 
     // if (outfile) fprintf (outfile, "arrive %s %d\n", t->name, sim_time);
 
-    reschedule ();
-
-    // schedule check for missed deadline
-    {
-        struct event* e = new_event (DEADLINE);
-        e->task = t;
-        e->inst = ti;
-        insert_event (e, sim_time + t->D);
-    }
+    ti = (struct task_instance*) xmalloc (sizeof (struct task_instance));
+    ti->arrival = sim_time;
+    ti->deadline = sim_time + t->D;
+    ti->exec = sample_exec (t);
+    ti->missed = FALSE;
+    ti->next = NULL;
 
-    // schedule subsequent arrival of this task
+    // time of the subsequent arrival of this task
     {
-        struct event* e = new_event (ARRIVE);
         int add;
-        e->task = t;
 
 #if 1
         // randomly mess with task phasing
@@ -358,17 +555,14 @@ static void arrive (struct task* t)
         add = 0;
 #endif
 
-        insert_event (e, sim_time + t->T + add);
+        t->next_arrival = sim_time + t->T + add;
     }
 
-    // schedule release of this task
+    // release time of this job
     {
-        struct event* e = new_event (RELEASE);
         time_value te;
         double r;
 
-        e->task = t;
-        e->inst = ti;
         r = rand_double();
         if (r < 0.33) {
             te = sim_time;
@@ -391,59 +585,112 @@ static void arrive (struct task* t)
         }
         t->last_arrival = te+1;
 
-        insert_event (e, te);
+        ti->release = te;
         DBGPrint (5, ("         task %s will be released at time %d\n",
-                      e->task->name, te));
+                      t->name, te));
+    }
+
+    if (t->next_inst) {
+        assert (t->last_inst);
+        t->last_inst->next = ti;
+        t->last_inst = ti;
+    }
+    else {
+        assert (!t->last_inst);
+        t->next_inst = t->last_inst = ti;
+    }
+    if (!t->unreleased_inst) {
+        t->unreleased_inst = ti;
     }
 }
 
-static void deadline (struct task* t, struct task_instance* ti)
+/*
+ * start the oldest waiting job if it has been released; jobs released
+ * while an earlier one is still running wait until it completes
+ */
+static void release (struct task* t)
 {
-    assert (t);
-    assert (ti);
+    struct task_instance* ti;
 
-    if (outfile) fprintf (outfile, "deadline %s %d\n", t->name, sim_time);
+    if (t->cur_inst) return;
 
-    if (ti->completed) {
-        xfree (ti);
-        total_hits++;
+    ti = get_released_instance (t);
+    if (ti) {
+        run_instance (t, ti);
     }
-    else {
-        ti->missed = TRUE;
-        total_misses++;
+}
+
+/*
+ * a job misses once time passes its deadline without it completing;
+ * a job that completes exactly at its deadline is on time
+ */
+static void deadline (struct task* t, struct task_instance* ti)
+{
+    if (ti->missed || ti->deadline >= sim_time) return;
+
+    if (outfile) fprintf (outfile, "deadline %s %d\n", t->name, ti->deadline);
+    ti->missed = TRUE;
+    count_miss (t, ti);
+}
+
+static void check_deadlines (struct task* t)
+{
+    struct task_instance* ti;
+
+    if (t->cur_inst) deadline (t, t->cur_inst);
+    for (ti = t->next_inst; ti; ti = ti->next) {
+        deadline (t, ti);
     }
 }
 
-static void defer_instance (struct task* t, struct task_instance* ti)
+/*
+ * when the task's event next needs to be processed
+ */
+static time_value next_task_event (struct task* t)
 {
-    assert (!ti->deferred);
-    ti->deferred = TRUE;
-    if (t->next_inst) {
-        assert (t->last_inst);
-        t->last_inst->next = ti;
-        t->last_inst = ti;
+    time_value next = t->next_arrival;
+    struct task_instance* ti;
+
+    // released jobs are picked up when the running one completes
+    while (t->unreleased_inst && t->unreleased_inst->release <= sim_time) {
+        t->unreleased_inst = t->unreleased_inst->next;
     }
-    else {
-        assert (!t->last_inst);
-        t->next_inst = t->last_inst = ti;
+    if (t->unreleased_inst && t->unreleased_inst->release < next) {
+        next = t->unreleased_inst->release;
     }
+
+    if (eager_deadlines) {
+        if (t->cur_inst && !t->cur_inst->missed &&
+            t->cur_inst->deadline + 1 < next) {
+            next = t->cur_inst->deadline + 1;
+        }
+        for (ti = t->next_inst; ti; ti = ti->next) {
+            if (!ti->missed) {
+                if (ti->deadline + 1 < next) next = ti->deadline + 1;
+                break;
+            }
+        }
+    }
+
+    return next;
 }
 
-static void release (struct task* t, struct task_instance* ti)
+static void task_event (struct task* t)
 {
-    assert (t);
-    assert (ti);
-
-    if (t->cur_inst) {
-        defer_instance (t, ti);
+    if (sim_time == t->next_arrival) {
+        arrive (t);
     }
-    else {
-        run_instance (t, ti);
-        reschedule ();
+    release (t);
+    if (eager_deadlines) {
+        check_deadlines (t);
     }
+    insert_event (&task_events[t - sim_ts->tasks], next_task_event (t));
 }
 
-static void process_event (struct event* e, time_value now)
+/*
+ * returns FALSE if the event turned out to be stale
+ */
+static int process_event (struct event* e, time_value now)
 {
     // something very wrong if this is not true
     assert (now >= sim_time);
@@ -451,32 +698,398 @@ static void process_event (struct event* e, time_value now)
     sim_time = now;
 
     switch (e->type) {
-        case ARRIVE:
-            DBGPrint (5, ("time %d: processing ARRIVE event for task %s\n",
+        case TASK_EVENT:
+            DBGPrint (5, ("time %d: processing event for task %s\n",
                           sim_time, e->task->name));
-            arrive (e->task);
+            task_event (e->task);
             break;
 
         case EXPIRATION:
+            // superseded by a later dispatch
+            if (now != expiration_time) return FALSE;
             DBGPrint (5, ("time %d: processing EXPIRATION event\n", sim_time));
-            reschedule ();
-            break;
-
-        case RELEASE:
-            DBGPrint (5, ("time %d: processing RELEASE event for task %s\n",
-                          sim_time, e->task->name));
-            release (e->task, e->inst);
-            break;
-
-        case DEADLINE:
-            DBGPrint (5, ("time %d: processing DEADLINE event for task %s\n",
-                          sim_time, e->task->name));
-            deadline (e->task, e->inst);
             break;
 
         default:
             assert (0);
     }
+
+    return TRUE;
+}
+
+/*
+ * Steady-state detection.  With fixed phasing and no jitter the
+ * schedule is a deterministic function of the scheduler state, so
+ * once the state at a hyperperiod boundary is identical to the state
+ * at an earlier boundary the simulation from then on repeats what
+ * happened in between.  At that point the remaining whole repetitions
+ * are skipped by adding their (known) contribution to the statistics
+ * and time-shifting the pending events; only the final partial
+ * repetition is simulated.
+ *
+ * The state includes the layout of the event heap, since that decides
+ * how simultaneous events are ordered; the layout does not always
+ * repeat after a single hyperperiod, so a window of recent boundaries
+ * is kept.
+ */
+int SIM_HYPERPERIOD = FALSE;
+
+#define NUM_SNAPSHOTS 64
+
+struct sim_snapshot {
+    int valid;
+    time_value* sig;
+    int sig_len;
+    int sig_max;
+    int total_misses, total_hits;
+#ifdef USE_DVS
+    energy_value energy_sum;
+#endif
+    int dispatch_count, switch_count;
+#ifdef USE_DVS
+    int freq_switch_count;
+#endif
+    time_value* max_response_time;
+    int* max_rt_seen;
+    struct task_stats* stats;
+};
+
+static struct sim_snapshot snaps[NUM_SNAPSHOTS];
+static int num_boundaries;
+static time_value hyperperiod;
+static time_value next_boundary;
+
+static time_value gcd (time_value a, time_value b)
+{
+    while (b != 0) {
+        time_value tmp = a % b;
+        a = b;
+        b = tmp;
+    }
+    return a;
+}
+
+/*
+ * least common multiple of the periods, or -1 if it exceeds limit
+ */
+static time_value find_hyperperiod (struct task_set* ts, time_value limit)
+{
+    time_value H = 1;
+    int i;
+
+    for (i=0; i<ts->num_tasks; i++) {
+        time_value T = ts->tasks[i].T;
+        time_value m = H / gcd (H, T);
+        if (m > limit / T) return -1;
+        H = m * T;
+    }
+
+    return H;
+}
+
+static void sig_push (struct sim_snapshot* s, time_value v)
+{
+    if (s->sig_len == s->sig_max) {
+        s->sig_max = (s->sig_max) ? 2*s->sig_max : 256;
+        s->sig = (time_value*) realloc (s->sig, s->sig_max * sizeof (time_value));
+        assert (s->sig);
+    }
+    s->sig[s->sig_len++] = v;
+}
+
+static void sig_push_instance (struct sim_snapshot* s,
+                               struct task_instance* ti,
+                               time_value base)
+{
+    if (!ti) {
+        sig_push (s, -1);
+        return;
+    }
+    sig_push (s, ti->arrival - base);
+    sig_push (s, ti->release - base);
+    sig_push (s, ti->missed);
+}
+
+static int task_index (struct task* t)
+{
+    return (t) ? (int)(t - sim_ts->tasks) : -1;
+}
+
+/*
+ * record everything that determines the future of the simulation,
+ * with times made relative to the boundary
+ */
+static void take_snapshot (struct sim_snapshot* s, time_value base)
+{
+    unsigned int k;
+    int i;
+
+    s->sig_len = 0;
+
+    sig_push (s, task_index (current));
+    sig_push (s, last_reschedule - base);
+    sig_push (s, last_record - base);
+    sig_push (s, expiration_time - base);
+#ifdef USE_DVS
+    sig_push (s, last_level);
+#endif
+
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        struct task* t = &sim_ts->tasks[i];
+        struct task_instance* ti;
+
+        sig_push (s, t->state);
+        sig_push (s, t->budget);
+        sig_push (s, t->effP);
+        sig_push (s, t->last_arrival - base);
+        sig_push (s, t->next_arrival - base);
+        sig_push_instance (s, t->cur_inst, base);
+        for (ti = t->next_inst; ti; ti = ti->next) {
+            sig_push_instance (s, ti, base);
+        }
+        sig_push (s, -2);
+
+        s->max_response_time[i] = t->max_response_time;
+        s->max_rt_seen[i] = t->max_rt_seen;
+        s->stats[i] = task_stats[i];
+    }
+
+    for (k=0; k<pri_q_size (); k++) {
+        time_value key;
+        struct event* e = (struct event*) pri_q_elt (k, &key);
+        sig_push (s, key - base);
+        sig_push (s, e->type);
+        sig_push (s, task_index (e->task));
+    }
+
+    s->total_misses = total_misses;
+    s->total_hits = total_hits;
+#ifdef USE_DVS
+    s->energy_sum = energy_sum;
+#endif
+    s->dispatch_count = dispatch_count;
+    s->switch_count = switch_count;
+#ifdef USE_DVS
+    s->freq_switch_count = freq_switch_count;
+#endif
+    s->valid = TRUE;
+}
+
+static int same_snapshot (struct sim_snapshot* s1, struct sim_snapshot* s2)
+{
+    if (!s1->valid || !s2->valid) return FALSE;
+    if (s1->sig_len != s2->sig_len) return FALSE;
+    return memcmp (s1->sig, s2->sig, s1->sig_len * sizeof (time_value)) == 0;
+}
+
+/*
+ * move every pending time stamp forward by delta
+ */
+static void shift_job (struct task_instance* ti, time_value delta)
+{
+    ti->arrival += delta;
+    ti->release += delta;
+    ti->deadline += delta;
+}
+
+static void shift_sim_state (time_value delta)
+{
+    int i;
+
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        struct task* t = &sim_ts->tasks[i];
+        struct task_instance* ti;
+        if (t->cur_inst) shift_job (t->cur_inst, delta);
+        for (ti = t->next_inst; ti; ti = ti->next) shift_job (ti, delta);
+        t->last_arrival += delta;
+        t->next_arrival += delta;
+        t->last_scheduled += delta;
+    }
+
+    pri_q_shift_keys (delta);
+    sim_time += delta;
+    last_reschedule += delta;
+    last_record += delta;
+    expiration_time += delta;
+}
+
+/*
+ * what happened between snapshots prev and now repeats reps more
+ * times; account for it and jump ahead by reps*len
+ */
+static void skip_repetitions (struct sim_snapshot* prev,
+                              struct sim_snapshot* now,
+                              int reps,
+                              time_value len)
+{
+    int i;
+
+    DBGPrint (4, ("steady state at %d; skipping %d repetitions of %d\n",
+                  next_boundary, reps, len));
+
+    total_misses += reps * (now->total_misses - prev->total_misses);
+    total_hits += reps * (now->total_hits - prev->total_hits);
+#ifdef USE_DVS
+    energy_sum += reps * (now->energy_sum - prev->energy_sum);
+#endif
+    dispatch_count += reps * (now->dispatch_count - prev->dispatch_count);
+    switch_count += reps * (now->switch_count - prev->switch_count);
+#ifdef USE_DVS
+    freq_switch_count += reps * (now->freq_switch_count - prev->freq_switch_count);
+#endif
+
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        int seen;
+        if (now->max_response_time[i] == prev->max_response_time[i]) {
+            seen = now->max_rt_seen[i] - prev->max_rt_seen[i];
+        }
+        else {
+            // the maximum was first reached during the repeating interval
+            seen = now->max_rt_seen[i];
+        }
+        sim_ts->tasks[i].max_rt_seen += reps * seen;
+
+        hist_add_delta (&task_stats[i].resp,
+                        &now->stats[i].resp, &prev->stats[i].resp, reps);
+        task_stats[i].late += reps * (now->stats[i].late - prev->stats[i].late);
+        task_stats[i].preemptions +=
+            reps * (now->stats[i].preemptions - prev->stats[i].preemptions);
+        task_stats[i].switches +=
+            reps * (now->stats[i].switches - prev->stats[i].switches);
+        task_stats[i].freq_switches +=
+            reps * (now->stats[i].freq_switches - prev->stats[i].freq_switches);
+    }
+
+    shift_sim_state (reps * len);
+}
+
+/*
+ * called before each event is extracted; snapshots are taken when the
+ * next event is at or beyond a hyperperiod boundary
+ */
+static void check_steady_state (time_value end_time)
+{
+    while (hyperperiod > 0 && pri_q_min_key () >= next_boundary) {
+        struct sim_snapshot* now = &snaps[num_boundaries % NUM_SNAPSHOTS];
+        int back;
+
+        take_snapshot (now, next_boundary);
+        num_boundaries++;
+
+        for (back=1; back<NUM_SNAPSHOTS && back<num_boundaries; back++) {
+            struct sim_snapshot* prev =
+                &snaps[(num_boundaries-1-back) % NUM_SNAPSHOTS];
+            if (same_snapshot (prev, now)) {
+                time_value len = back * hyperperiod;
+                int reps = (end_time - next_boundary) / len;
+                /*
+                 * repeating an interval that has misses would carry
+                 * us past the miss limit
+                 */
+                if (reps > 0 &&
+                    !(SIM_MAX_MISSES && now->total_misses != prev->total_misses)) {
+                    skip_repetitions (prev, now, reps, len);
+                }
+                hyperperiod = 0;
+                return;
+            }
+        }
+
+        next_boundary += hyperperiod;
+    }
+}
+
+static void init_steady_state (time_value end_time)
+{
+    int i;
+
+    hyperperiod = 0;
+
+    if (!SIM_HYPERPERIOD || outfile || has_jitter (sim_ts) || has_aet (sim_ts)) return;
+#ifdef USE_DVS
+    if (SIM_DVS_POLICY) return;
+#endif
+
+    hyperperiod = find_hyperperiod (sim_ts, end_time / 2);
+    if (hyperperiod <= 0) {
+        hyperperiod = 0;
+        return;
+    }
+
+    DBGPrint (4, ("hyperperiod is %d\n", hyperperiod));
+
+    next_boundary = 0;
+    num_boundaries = 0;
+    for (i=0; i<NUM_SNAPSHOTS; i++) {
+        snaps[i].valid = FALSE;
+        snaps[i].sig = NULL;
+        snaps[i].sig_len = snaps[i].sig_max = 0;
+        snaps[i].max_response_time =
+            (time_value*) xmalloc (sim_ts->num_tasks * sizeof (time_value));
+        snaps[i].max_rt_seen = (int*) xmalloc (sim_ts->num_tasks * sizeof (int));
+        snaps[i].stats = (struct task_stats*)
+                         xmalloc (sim_ts->num_tasks * sizeof (struct task_stats));
+    }
+}
+
+static void deinit_steady_state (void)
+{
+    int i;
+
+    if (!snaps[0].max_rt_seen) return;
+
+    for (i=0; i<NUM_SNAPSHOTS; i++) {
+        free (snaps[i].sig);
+        xfree (snaps[i].max_response_time);
+        xfree (snaps[i].max_rt_seen);
+        xfree (snaps[i].stats);
+        snaps[i].sig = NULL;
+        snaps[i].max_response_time = NULL;
+        snaps[i].max_rt_seen = NULL;
+        snaps[i].stats = NULL;
+    }
+}
+
+/*
+ * runtime DVS and switching overheads are outside the analysis, so
+ * simulated response times may legitimately exceed analytic ones
+ */
+static int analysis_covers_simulation (void)
+{
+#ifdef USE_DVS
+    if (SIM_DVS_POLICY || SIM_FREQ_SWITCH_TIME > 0) return FALSE;
+#endif
+    return SIM_SWITCH_TIME == 0;
+}
+
+static void write_summary (FILE* fp, time_value end_time)
+{
+    int i;
+
+    fprintf (fp, "# %s: %d tasks, %d time units, %d misses, %d hits\n",
+             sim_ts->name, sim_ts->num_tasks, end_time,
+             total_misses, total_hits);
+    fprintf (fp, "# task\tjobs\tmin\tmean\tp50\tp99\tp99.9\tmax\tR"
+             "\tlate\tmax_late\tpreempt\tswitch\tfswitch\n");
+
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        struct task_stats* st = &task_stats[i];
+        fprintf (fp, "%s\t%d\t%d\t%f\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%d\n",
+                 sim_ts->tasks[i].name,
+                 st->resp.count,
+                 st->resp.min,
+                 hist_mean (&st->resp),
+                 hist_percentile (&st->resp, 50.0),
+                 hist_percentile (&st->resp, 99.0),
+                 hist_percentile (&st->resp, 99.9),
+                 st->resp.max,
+                 sim_ts->tasks[i].R,
+                 st->late,
+                 st->max_lateness,
+                 st->preemptions,
+                 st->switches,
+                 st->freq_switches);
+    }
 }
 
 void simulate (struct task_set* taskset,
@@ -506,6 +1119,23 @@ void simulate (struct task_set* taskset,
     total_misses = 0;
     total_hits = 0;
 
+    task_stats = (struct task_stats*)
+                 xmalloc (sim_ts->num_tasks * sizeof (struct task_stats));
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        hist_reset (&task_stats[i].resp);
+        task_stats[i].max_lateness = 0;
+        task_stats[i].late = 0;
+        task_stats[i].preemptions = 0;
+        task_stats[i].switches = 0;
+        task_stats[i].freq_switches = 0;
+    }
+    dispatch_count = 0;
+    switch_count = 0;
+#ifdef USE_DVS
+    freq_switch_count = 0;
+    last_level = -1;
+#endif
+
     if (outfile_name) {
         outfile = fopen (outfile_name, "w");
         if (!outfile) {
@@ -515,10 +1145,14 @@ void simulate (struct task_set* taskset,
     else {
         outfile = NULL;
     }
+    eager_deadlines = (outfile != NULL || SIM_MAX_MISSES);
+    first_miss_time = -1;
+    first_miss_task = -1;
 
-    for (i=0; i<sim_ts->num_tasks; i++) {
-        struct event* e;
+    task_events = (struct event*) xmalloc (sim_ts->num_tasks * sizeof (struct event));
+    expiration_time = -1;
 
+    for (i=0; i<sim_ts->num_tasks; i++) {
         assert (sim_ts->tasks[i].P >= 0 && sim_ts->tasks[i].P < sim_ts->num_tasks);
         assert (sim_ts->tasks[i].PT >= 0 && sim_ts->tasks[i].PT < sim_ts->num_tasks);
 
@@ -530,8 +1164,13 @@ void simulate (struct task_set* taskset,
         sim_ts->tasks[i].cur_inst = NULL;
         sim_ts->tasks[i].next_inst = NULL;
         sim_ts->tasks[i].last_inst = NULL;
+        sim_ts->tasks[i].unreleased_inst = NULL;
         sim_ts->tasks[i].effP = sim_ts->tasks[i].P;
+#ifdef USE_DVS
+        sim_ts->tasks[i].run_f = sim_ts->tasks[i].f;
+#endif
         sim_ts->tasks[i].last_arrival = 0;
+        sim_ts->tasks[i].next_arrival = 0;
 
 #define PHASE_TIMES 10
 
@@ -543,9 +1182,9 @@ void simulate (struct task_set* taskset,
             i, sim_ts->tasks[i].T, sim_ts->tasks[i].phase_prob);
         */
 
-        e = new_event (ARRIVE);
-        e->task = &sim_ts->tasks[i];
-        insert_event (e, 0);
+        task_events[i].type = TASK_EVENT;
+        task_events[i].task = &sim_ts->tasks[i];
+        insert_event (&task_events[i], 0);
 
         if (outfile) fprintf (outfile, "pri %s %d\n",
                                   sim_ts->tasks[i].name, sim_ts->tasks[i].P);
@@ -553,40 +1192,84 @@ void simulate (struct task_set* taskset,
 
     if (outfile) fprintf (outfile, "pri idle %d\n", sim_ts->num_tasks);
 
+    init_steady_state (end_time);
+
+    // skipping repeated hyperperiods needs fixed phasing
+    if (hyperperiod > 0) {
+        for (i=0; i<sim_ts->num_tasks; i++) {
+            sim_ts->tasks[i].phase_prob = 0.0;
+        }
+    }
+
+#ifdef USE_DVS
+    if (SIM_DVS_POLICY && SIM_DVS_POLICY->start) {
+        SIM_DVS_POLICY->start (sim_ts);
+    }
+#endif
+
     while (!sim_finished) {
         struct event* e;
         time_value now;
-        now = pri_q_extract_min ((void**)&e);
-        assert (e);
-        process_event (e, now);
-        xfree (e);
+        int changed = FALSE;
+
+        check_steady_state (end_time);
+
+        /*
+         * everything that happens at one instant is handled before the
+         * scheduler runs, so simultaneous releases don't cause
+         * zero-length dispatches
+         */
+        do {
+            now = pri_q_extract_min ((void**)&e);
+            assert (e);
+            changed |= process_event (e, now);
+        } while (pri_q_min_key () == now);
+
+        if (changed) reschedule ();
         if (sim_time >= end_time) sim_finished = TRUE;
     }
 
-    /*
-     * avoid leaking memory by draining the event queue
-     *
-     * cleaning up task instances is slightly tricky; the relevant
-     * invariant is that every task instance is (1) pointed to by an
-     * upcoming deadline event and (2) is either a task's cur_inst or on
-     * its deferred list
-     */
+    // events are not allocated individually; just drain the queue
     while (1) {
         struct event* e;
         pri_q_extract_min ((void**)&e);
         if (!e) break;
-        if (e->type == DEADLINE) {
-            if (!e->inst->deferred) {
-                for (i=0; i<sim_ts->num_tasks; i++) {
-                    if (sim_ts->tasks[i].cur_inst == e->inst) goto out;
-                }
-                xfree (e->inst);
-out:
-                ;
+    }
+    xfree (task_events);
+    task_events = NULL;
+
+    /*
+     * jobs left over whose deadlines have passed are misses; the rest
+     * are not counted either way
+     */
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        struct task* t = &sim_ts->tasks[i];
+        struct task_instance* ti;
+
+        if (t->cur_inst) {
+            if (!t->cur_inst->missed && t->cur_inst->deadline < sim_time) {
+                count_miss (t, t->cur_inst);
+            }
+            xfree (t->cur_inst);
+            t->cur_inst = NULL;
+        }
+        while ((ti = t->next_inst) != NULL) {
+            if (!ti->missed && ti->deadline < sim_time) {
+                count_miss (t, ti);
             }
+            t->next_inst = ti->next;
+            xfree (ti);
         }
-        xfree (e);
+        t->last_inst = NULL;
+        t->unreleased_inst = NULL;
+    }
+
+    deinit_steady_state ();
+#ifdef USE_DVS
+    if (SIM_DVS_POLICY && SIM_DVS_POLICY->stop) {
+        SIM_DVS_POLICY->stop (sim_ts);
     }
+#endif
 
     DBGPrint (5, ("simulation finished\n"));
 
@@ -605,17 +1288,6 @@ out:
     feasible (sim_ts, TRUE);
 
     for (i=0; i<sim_ts->num_tasks; i++) {
-
-        // clean up remaining task instances
-        while (1) {
-            struct task_instance* ti = get_deferred_instance (&sim_ts->tasks[i]);
-            if (!ti) break;
-            xfree (ti);
-        }
-        if (sim_ts->tasks[i].cur_inst) {
-            xfree (sim_ts->tasks[i].cur_inst);
-        }
-
         DBGPrint (3, ("  %s max resp time: analytic %d, sim %d (at %d) (off by %d) (%d times)\n",
                       sim_ts->tasks[i].name,
                       sim_ts->tasks[i].R,
@@ -623,7 +1295,7 @@ out:
                       sim_ts->tasks[i].timeof_max_response_time,
                       (sim_ts->tasks[i].R - sim_ts->tasks[i].max_response_time),
                       sim_ts->tasks[i].max_rt_seen));
-        if (all_schedulable && OVERRUN_FRAC == 0.0) {
+        if (all_schedulable && OVERRUN_FRAC == 0.0 && analysis_covers_simulation ()) {
             if (sim_ts->tasks[i].max_response_time > sim_ts->tasks[i].R) {
                 save_task_set_source_code_with_pri (sim_ts);
                 print_task_set (sim_ts);
@@ -632,7 +1304,24 @@ out:
         }
     }
 
-    if (OVERRUN_FRAC != 0.0) {
+    if (SIM_SUMMARY_FP) {
+        write_summary (SIM_SUMMARY_FP, end_time);
+    }
+    if (last_counters_max < sim_ts->num_tasks) {
+        if (last_counters) xfree (last_counters);
+        last_counters_max = sim_ts->num_tasks;
+        last_counters = (struct task_counters*)
+                        xmalloc (last_counters_max * sizeof (struct task_counters));
+    }
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        last_counters[i].preemptions = task_stats[i].preemptions;
+        last_counters[i].switches = task_stats[i].switches;
+        last_counters[i].freq_switches = task_stats[i].freq_switches;
+    }
+    xfree (task_stats);
+    task_stats = NULL;
+
+    if (OVERRUN_FRAC != 0.0 && miss_file) {
         // printf ("%f %d\n", overrun_frac, total_misses);
         fprintf (miss_file, "%d %d\n", (int)(100*overrun_frac), total_misses);
     }
@@ -640,21 +1329,254 @@ out:
     deinit_pri_q ();
     sim_ts = NULL;
 }
+
+int sim_last_misses (void)
+{
+    return total_misses;
+}
+
+int simulate_first_miss (struct task_set* taskset,
+                         time_value end_time,
+                         double overrun_frac,
+                         time_value* miss_time,
+                         int* miss_task)
+{
+    int old_max = SIM_MAX_MISSES;
+
+    SIM_MAX_MISSES = 1;
+    simulate (taskset, end_time, NULL, overrun_frac, NULL, NULL);
+    SIM_MAX_MISSES = old_max;
+
+    if (miss_time) *miss_time = first_miss_time;
+    if (miss_task) *miss_task = first_miss_task;
+
+    return first_miss_task != -1;
+}
+
 #ifdef USE_DVS
 void simulate_power (struct task_set* taskset,
                      time_value end_time,
                      FILE* power_fp)
 {
+    int i;
+
     energy_sum = 0;
     power = 0;
-#ifdef USE_COUNT_DISPATCH
-    dispatch_count = 0;
-#endif
     simulate (taskset,end_time,NULL,0.0,NULL,NULL);
 
-    fprintf(power_fp, "%d\t%f\t%d\n",
+    fprintf(power_fp, "%d\t%f\t%d\t%d\t%d",
             end_time,
             energy_sum,
-            dispatch_count);
+            dispatch_count,
+            switch_count,
+            freq_switch_count);
+    for (i=0; i<taskset->num_tasks; i++) {
+        fprintf(power_fp, "\t%d\t%d",
+                last_counters[i].preemptions,
+                last_counters[i].freq_switches);
+    }
+    fprintf(power_fp, "\n");
+}
+
+/*
+ * energy used over end_time in a simulation without overruns
+ */
+energy_value simulate_energy (struct task_set* taskset,
+                              time_value end_time)
+{
+    energy_sum = 0;
+    simulate (taskset,end_time,NULL,0.0,NULL,NULL);
+
+    return energy_sum;
+}
+
+time_value sim_now (void)
+{
+    return sim_time;
+}
+
+time_value sim_next_release (void)
+{
+    time_value next = MAX_TIME_VALUE;
+    int i;
+
+    for (i=0; i<sim_ts->num_tasks; i++) {
+        struct task* t = &sim_ts->tasks[i];
+        struct task_instance* ti;
+
+        if (t->next_arrival > sim_time && t->next_arrival < next) {
+            next = t->next_arrival;
+        }
+        for (ti = t->unreleased_inst; ti; ti = ti->next) {
+            if (ti->release > sim_time) {
+                if (ti->release < next) next = ti->release;
+                break;
+            }
+        }
+    }
+
+    return next;
 }
+
+time_value sim_wc_remaining (struct task_set* ts, int t)
+{
+    struct task* tk = &ts->tasks[t];
+
+    if (!tk->cur_inst || tk->wc_work <= 0) return 0;
+    return (time_value) ceil (tk->wc_work / ts->profile->levels[tk->f].f - 1e-9);
+}
+
+int sim_others_waiting (struct task_set* ts, int t)
+{
+    int i;
+
+    for (i=0; i<ts->num_tasks; i++) {
+        if (i != t && ts->tasks[i].state == READY) return TRUE;
+    }
+    // a job of t's own that is already released waits as well
+    return ts->tasks[t].next_inst && ts->tasks[t].next_inst->release <= sim_time;
+}
+
+/*
+ * slowest level, no faster than task t's own, that runs at least at
+ * the given speed
+ */
+static freq_level slowest_level_at_least (struct task_set* ts, int t, double speed)
+{
+    freq_level f = ts->tasks[t].f;
+
+    while (f > MIN_FREQ_LEVEL && ts->profile->levels[f-1].f >= speed - 1e-12) {
+        f--;
+    }
+    return f;
+}
+
+/*
+ * cycle-conserving: each task counts at its worst-case utilization
+ * from a job's release until it completes, and at the utilization it
+ * actually used after that; every job is slowed by the ratio of the
+ * total to the worst case
+ */
+static double* cc_util;
+static double cc_wc_total;
+
+static void cc_start (struct task_set* ts)
+{
+    int i;
+
+    cc_util = (double*) xmalloc (ts->num_tasks * sizeof (double));
+    cc_wc_total = 0;
+    for (i=0; i<ts->num_tasks; i++) {
+        cc_util[i] = (double) ts->tasks[i].C / ts->tasks[i].T;
+        cc_wc_total += cc_util[i];
+    }
+}
+
+static void cc_release (struct task_set* ts, int t)
+{
+    cc_util[t] = (double) ts->tasks[t].C / ts->tasks[t].T;
+}
+
+static void cc_complete (struct task_set* ts, int t, time_value slack)
+{
+    cc_util[t] = (double) (ts->tasks[t].C - slack) / ts->tasks[t].T;
+    if (cc_util[t] < 0) cc_util[t] = 0;
+}
+
+static freq_level cc_level (struct task_set* ts, int t)
+{
+    double total = 0;
+    int i;
+
+    for (i=0; i<ts->num_tasks; i++) {
+        total += cc_util[i];
+    }
+    return slowest_level_at_least (ts, t,
+                                   ts->profile->levels[ts->tasks[t].f].f * total / cc_wc_total);
+}
+
+static void cc_stop (struct task_set* ts)
+{
+    xfree (cc_util);
+    cc_util = NULL;
+}
+
+const struct sim_dvs_policy sim_dvs_cycle_conserving = {
+    "cycle_conserving", cc_start, cc_release, cc_complete, cc_level, cc_stop
+};
+
+/*
+ * stretch: with nothing else waiting, the processor would idle from
+ * the end of the job's worst case until the next release, so the job
+ * may as well use that time
+ */
+static freq_level stretch_level (struct task_set* ts, int t)
+{
+    time_value next = sim_next_release ();
+    time_value wc = sim_wc_remaining (ts, t);
+
+    if (next == MAX_TIME_VALUE || wc <= 0 || sim_others_waiting (ts, t)) {
+        return ts->tasks[t].f;
+    }
+    return slowest_level_at_least (ts, t,
+                                   ts->profile->levels[ts->tasks[t].f].f * wc / (next - sim_time));
+}
+
+const struct sim_dvs_policy sim_dvs_stretch = {
+    "stretch", NULL, NULL, NULL, stretch_level, NULL
+};
+
+/*
+ * slack: the static schedule would have kept the completing job
+ * running for the rest of its WCET.  The job dispatched at that
+ * instant can use the time instead, and finish no later than it would
+ * have, provided every task that could have preempted the completing
+ * job can preempt it too (its threshold is no higher).  Arrivals
+ * change the picture, so the slack is only good until the next
+ * release.
+ */
+static time_value slack_amount;
+static time_value slack_given;
+static int slack_pt;
+static int slack_task;
+static time_value slack_until;
+static time_value slack_expiry;
+
+static void slack_start (struct task_set* ts)
+{
+    slack_amount = 0;
+    slack_task = -1;
+}
+
+static void slack_complete (struct task_set* ts, int t, time_value slack)
+{
+    slack_amount = slack;
+    slack_given = sim_time;
+    slack_pt = ts->tasks[t].PT;
+}
+
+static freq_level slack_level (struct task_set* ts, int t)
+{
+    time_value wc = sim_wc_remaining (ts, t);
+
+    // the job dispatched when the slack was freed gets it
+    if (slack_amount > 0 && slack_given == sim_time && ts->tasks[t].PT >= slack_pt) {
+        slack_task = t;
+        slack_until = sim_time + slack_amount + wc;
+        slack_expiry = sim_next_release ();
+        slack_amount = 0;
+    }
+
+    if (slack_task != t || sim_time >= slack_expiry ||
+        sim_time >= slack_until || wc <= 0) {
+        slack_task = -1;
+        return ts->tasks[t].f;
+    }
+    return slowest_level_at_least (ts, t,
+                                   ts->profile->levels[ts->tasks[t].f].f * wc / (slack_until - sim_time));
+}
+
+const struct sim_dvs_policy sim_dvs_slack = {
+    "slack", slack_start, NULL, slack_complete, slack_level, NULL
+};
 #endif
@@ -48,6 +48,11 @@ time_value get_period (struct task_set* ts, int t)
     return ts->tasks[t].T;
 }
 
+time_value get_deadline (struct task_set* ts, int t)
+{
+    return ts->tasks[t].D;
+}
+
 void set_jitter (struct task_set* ts, int t, int J)
 {
     assert (ts);
@@ -74,6 +79,8 @@ time_value get_wcet (struct task_set* ts, int t)
 
 int internal_set_analysis (struct spak_analysis* A, const char* which)
 {
+    memset (A, 0, sizeof (struct spak_analysis));
+
     // relies on short-circuit behavior
     if (!get_analysis1_ptrs (which, A) &&
         !get_analysis2_ptrs (which, A) &&
@@ -168,6 +175,12 @@ struct task_set* create_task_set (int max_tasks,
     ts->Cql = Cql;
     ts->Cqs = Cqs;
 
+#ifdef USE_DVS
+    ts->profile = default_dvfs_profile ();
+#endif
+
+    ts->undo = NULL;
+
     return ts;
 }
 
@@ -179,6 +192,7 @@ struct task_set* copy_task_set (struct task_set* ts1)
 
     ts2 = (struct task_set*) xmalloc (sizeof (struct task_set));
     *ts2 = *ts1;
+    ts2->undo = NULL;
 
     {
         unsigned int size = ts1->max_tasks * sizeof (struct task);
@@ -201,6 +215,15 @@ struct task_set* copy_task_set (struct task_set* ts1)
         memcpy (ts2->locks, ts1->locks, size);
     }
 
+    // the locks point into the task and semaphore arrays
+    {
+        int i;
+        for (i=0; i<ts1->num_locks; i++) {
+            ts2->locks[i].task = ts2->tasks + (ts1->locks[i].task - ts1->tasks);
+            ts2->locks[i].sem = ts2->sems + (ts1->locks[i].sem - ts1->sems);
+        }
+    }
+
     if (ts1->max_task_clusters > 0) {
         unsigned int size = ts1->max_task_clusters * sizeof (struct task_cluster);
         ts2->task_clusters = (struct task_cluster*) xmalloc (size);
@@ -220,9 +243,141 @@ void free_task_set (struct task_set* ts)
     if (ts->sems) xfree (ts->sems);
     if (ts->locks) xfree (ts->locks);
     if (ts->task_clusters) xfree (ts->task_clusters);
+    if (ts->undo) stop_undo_log (ts);
     xfree (ts);
 }
 
+/*
+ * have the permutation and constraint routines record what they
+ * overwrite, so that an annealer can mutate ts in place and roll back
+ * a rejected move with undo_changes()
+ */
+void start_undo_log (struct task_set* ts)
+{
+    struct undo_log* u;
+    int n = ts->max_tasks + ts->max_task_clusters;
+
+    assert (ts);
+    assert (!ts->undo);
+
+    u = (struct undo_log*) xmalloc (sizeof (struct undo_log));
+    u->num_entries = 0;
+    u->entries = (struct undo_entry*) xmalloc (n * sizeof (struct undo_entry));
+    u->saved = (char*) xmalloc (n);
+    memset (u->saved, 0, n);
+    ts->undo = u;
+}
+
+void stop_undo_log (struct task_set* ts)
+{
+    assert (ts);
+    assert (ts->undo);
+
+    xfree (ts->undo->entries);
+    xfree (ts->undo->saved);
+    xfree (ts->undo);
+    ts->undo = NULL;
+}
+
+static void forget_changes (struct undo_log* u, int max_tasks)
+{
+    int i;
+
+    for (i=0; i<u->num_entries; i++) {
+        int w = u->entries[i].what;
+        u->saved[(w >= 0) ? w : max_tasks-1-w] = 0;
+    }
+    u->num_entries = 0;
+}
+
+/*
+ * accept the current move
+ */
+void keep_changes (struct task_set* ts)
+{
+    assert (ts);
+    assert (ts->undo);
+
+    forget_changes (ts->undo, ts->max_tasks);
+}
+
+/*
+ * reject the current move, restoring ts to where the move started
+ */
+void undo_changes (struct task_set* ts)
+{
+    struct undo_log* u;
+    int i;
+
+    assert (ts);
+    assert (ts->undo);
+
+    u = ts->undo;
+    for (i=0; i<u->num_entries; i++) {
+        struct undo_entry* e = &u->entries[i];
+        if (e->what >= 0) {
+            ts->tasks[e->what].P = e->P;
+            ts->tasks[e->what].PT = e->PT;
+#ifdef USE_DVS
+            ts->tasks[e->what].f = e->f;
+            ts->tasks[e->what].C = e->C;
+#endif
+        }
+        else {
+            ts->task_clusters[-1-e->what].merge = e->P;
+        }
+    }
+    forget_changes (u, ts->max_tasks);
+}
+
+/*
+ * call before changing the priority or threshold of task t
+ */
+void save_task_pri (struct task_set* ts, int t)
+{
+    struct undo_log* u = ts->undo;
+    struct undo_entry* e;
+
+    if (!u || u->saved[t]) return;
+
+    u->saved[t] = 1;
+    e = &u->entries[u->num_entries++];
+    e->what = t;
+    e->P = ts->tasks[t].P;
+    e->PT = ts->tasks[t].PT;
+#ifdef USE_DVS
+    e->f = ts->tasks[t].f;
+    e->C = ts->tasks[t].C;
+#endif
+}
+
+#ifdef USE_DVS
+/*
+ * call before changing the frequency level, and so the WCET, of task t;
+ * a task's entry covers all of these
+ */
+void save_task_freq (struct task_set* ts, int t)
+{
+    save_task_pri (ts, t);
+}
+#endif
+
+/*
+ * call before changing the merge flag of cluster c
+ */
+void save_cluster_merge (struct task_set* ts, int c)
+{
+    struct undo_log* u = ts->undo;
+    struct undo_entry* e;
+
+    if (!u || u->saved[ts->max_tasks+c]) return;
+
+    u->saved[ts->max_tasks+c] = 1;
+    e = &u->entries[u->num_entries++];
+    e->what = -1-c;
+    e->P = ts->task_clusters[c].merge;
+}
+
 void make_all_preemptible (struct task_set* ts)
 {
     int i;
@@ -230,6 +385,7 @@ void make_all_preemptible (struct task_set* ts)
     assert (ts);
 
     for (i=0; i<ts->num_tasks; i++) {
+        save_task_pri (ts, i);
         ts->tasks[i].PT = ts->tasks[i].P;
     }
 }
@@ -248,6 +404,7 @@ void make_all_nonpreemptible (struct task_set* ts)
     }
 
     for (i=0; i<ts->num_tasks; i++) {
+        save_task_pri (ts, i);
         ts->tasks[i].PT = min;
     }
 }
@@ -434,6 +591,36 @@ int has_jitter (struct task_set* ts)
     return FALSE;
 }
 
+void set_task_aet (struct task_set* ts, int t, enum aet_dist dist, double a, double b)
+{
+    assert (ts);
+    assert (t >= 0 && t < ts->num_tasks);
+
+    ts->tasks[t].aet = dist;
+    ts->tasks[t].aet_a = a;
+    ts->tasks[t].aet_b = b;
+}
+
+void set_task_set_aet (struct task_set* ts, enum aet_dist dist, double a, double b)
+{
+    int i;
+
+    assert (ts);
+
+    for (i=0; i<ts->num_tasks; i++) {
+        set_task_aet (ts, i, dist, a, b);
+    }
+}
+
+int has_aet (struct task_set* ts)
+{
+    int i;
+    for (i=0; i<ts->num_tasks; i++) {
+        if (ts->tasks[i].aet != AET_WCET) return TRUE;
+    }
+    return FALSE;
+}
+
 int has_task_barriers (struct task_set* ts)
 {
     return ((ts->num_task_barriers > 0) ? TRUE : FALSE);
@@ -604,6 +791,7 @@ static void respect_task_barriers (struct task_set* ts, int* change)
                 DBGPrint (5, ("respect_task_barriers: task %d PT from %d to %d\n",
                               j, ts->tasks[j].P, bi+1));
                 *change = TRUE;
+                save_task_pri (ts, j);
                 ts->tasks[j].PT = bi+1;
             }
             if (j <= bi && ts->tasks[j].P > bi) {
@@ -617,6 +805,7 @@ static void respect_task_barriers (struct task_set* ts, int* change)
                 DBGPrint (5, ("respect_task_barriers: task %d PT from %d to %d\n",
                               j, ts->tasks[j].P, bi));
                 *change = TRUE;
+                save_task_pri (ts, j);
                 ts->tasks[j].PT = bi;
             }
         }
@@ -640,6 +829,7 @@ void respect_constraints_randomly (struct task_set* ts)
                     if (ts->tasks[tj].P < ts->tasks[tk].PT) {
                         change = TRUE;
                         if (rand_double() < 0.5) {
+                            save_task_pri (ts, tk);
                             ts->tasks[tk].PT = ts->tasks[tj].P;
                         }
                         else {
@@ -650,6 +840,7 @@ void respect_constraints_randomly (struct task_set* ts)
                     if (ts->tasks[tk].P < ts->tasks[tj].PT) {
                         change = TRUE;
                         if (rand_double() < 0.5) {
+                            save_task_pri (ts, tj);
                             ts->tasks[tj].PT = ts->tasks[tk].P;
                         }
                         else {
@@ -698,10 +889,12 @@ void respect_constraints (struct task_set* ts)
                      * instead of lowering priorities
                      */
                     if (ts->tasks[tj].P < ts->tasks[tk].PT) {
+                        save_task_pri (ts, tk);
                         ts->tasks[tk].PT = ts->tasks[tj].P;
                         change = TRUE;
                     }
                     if (ts->tasks[tk].P < ts->tasks[tj].PT) {
+                        save_task_pri (ts, tj);
                         ts->tasks[tj].PT = ts->tasks[tk].P;
                         change = TRUE;
                     }
@@ -780,6 +973,8 @@ int new_task (struct task_set* ts,
     ts->tasks[num].R = -1;
     ts->tasks[num].num = num;
     ts->tasks[num].thread = -1;
+    ts->tasks[num].aet = AET_WCET;
+    ts->tasks[num].aet_a = ts->tasks[num].aet_b = 0;
 
     ts->num_tasks++;
 
@@ -1151,6 +1346,7 @@ void assign_pri (struct task_set* ts,
         for (j=0; j<ts->num_tasks; j++) {
             int Pj = ts->tasks[j].P;
             if (Pj <= new_pri && Pj > old_pri) {
+                save_task_pri (ts, j);
                 ts->tasks[j].P--;
                 if (ts->tasks[j].PT > 0) {
                     ts->tasks[j].PT--;
@@ -1163,6 +1359,7 @@ void assign_pri (struct task_set* ts,
         for (j=0; j<ts->num_tasks; j++) {
             int Pj = ts->tasks[j].P;
             if (Pj >= new_pri && Pj < old_pri) {
+                save_task_pri (ts, j);
                 ts->tasks[j].P++;
                 if (ts->tasks[j].PT < ts->num_tasks-1) {
                     ts->tasks[j].PT++;
@@ -1170,6 +1367,7 @@ void assign_pri (struct task_set* ts,
             }
         }
     }
+    save_task_pri (ts, t);
     ts->tasks[t].P = new_pri;
 }
 
@@ -1191,6 +1389,7 @@ void assign_only_pri (struct task_set* ts,
         for (j=0; j<ts->num_tasks; j++) {
             int Pj = ts->tasks[j].P;
             if (Pj <= new_pri && Pj > old_pri) {
+                save_task_pri (ts, j);
                 ts->tasks[j].P--;
             }
         }
@@ -1200,10 +1399,12 @@ void assign_only_pri (struct task_set* ts,
         for (j=0; j<ts->num_tasks; j++) {
             int Pj = ts->tasks[j].P;
             if (Pj >= new_pri && Pj < old_pri) {
+                save_task_pri (ts, j);
                 ts->tasks[j].P++;
             }
         }
     }
+    save_task_pri (ts, t);
     ts->tasks[t].P = new_pri;
 }
 
@@ -1347,7 +1548,7 @@ void fprint_task_set (struct task_set* ts, FILE* fp)
                      ts->tasks[i].PT,
                      ts->tasks[i].S,
                      ts->tasks[i].Cu,
-                     valid_f_scale[ts->tasks[i].f]);
+                     ts->profile->levels[ts->tasks[i].f].f);
         }
 #else
         fprintf (fp, "Task Name       C       T       D       J       U       P       PT      S       R       Thr\n");
@@ -1678,6 +1879,28 @@ time_value modify_task_C_by_freq(time_value Cu, freq_scale freq)
     return (time_value)ceil(tmp);
 }
 
+/*
+ * C at every level of the task set's profile, so that changing a
+ * task's level (or asking what its C would be) is a lookup
+ */
+void fill_task_level_wcets (struct task_set* ts, int t)
+{
+    freq_level f;
+
+    for (f=MIN_FREQ_LEVEL; f<ts->profile->num_levels; f++) {
+        ts->tasks[t].Cf[f] = modify_task_C_by_freq (ts->tasks[t].Cu, ts->profile->levels[f].f);
+    }
+}
+
+time_value get_task_wcet_at_level (struct task_set* ts, int t, freq_level f)
+{
+    assert (ts);
+    assert (t<num_tasks(ts));
+    assert (f>=MIN_FREQ_LEVEL && f<ts->profile->num_levels);
+
+    return ts->tasks[t].Cf[f];
+}
+
 time_value get_Cu(struct task_set* ts, int t)
 {
     assert (ts);
@@ -1710,12 +1933,13 @@ int new_dvs_task (struct task_set* ts,
     // basic checking to help avoid weird errors later on
     assert (Cu >= 0);
     assert (f >= 0);
-    assert (f <= MAX_FREQ_LEVEL);
+    assert (f < ts->profile->num_levels);
 
-    C = modify_task_C_by_freq(Cu, valid_f_scale[f]);
+    C = modify_task_C_by_freq(Cu, ts->profile->levels[f].f);
     num = new_task(ts,C,T,t,n,D,J,B,name);
     ts->tasks[num].Cu = Cu;
     ts->tasks[num].f = f;
+    fill_task_level_wcets(ts,num);
 
     return num;
 }
@@ -50,6 +50,7 @@ struct task {
 #ifdef USE_DVS
   time_value Cu;   // WCET in MAX frequency
   freq_level f;
+  time_value Cf[MAX_DVFS_LEVELS]; // WCET at each level of the profile
 #endif
 
   /*
@@ -62,9 +63,18 @@ struct task {
   int max_rt_seen;
   enum task_state state;
   struct task_instance *cur_inst, *next_inst, *last_inst;
+  struct task_instance *unreleased_inst; // first waiting job not yet released
   int effP; // current effective priority (for preemption threshold scheduling)
   int last_arrival;
+  time_value next_arrival;
   double phase_prob;
+  int aet;         // actual execution time distribution (enum aet_dist)
+  double aet_a, aet_b;
+#ifdef USE_DVS
+  freq_level run_f; // level the current job runs at
+  double work;      // its remaining execution, in full-speed time
+  double wc_work;   // the same, had it needed its whole WCET
+#endif
 
   /*
    * for preemption threshold analysis
@@ -89,6 +99,14 @@ struct lock {
 struct spak_analysis {
   int (*valid)(struct task_set *);
   time_value (*response_time)(struct task_set *, int, time_value);
+  /*
+   * optional: response times of task i as only its own preemption
+   * threshold changes.  start() works out what doesn't depend on the
+   * threshold, response_time() uses it, end() releases it.
+   */
+  void *(*thresh_sweep_start)(struct task_set *, int);
+  time_value (*thresh_sweep_response_time)(struct task_set *, int, void *);
+  void (*thresh_sweep_end)(void *);
 };
 
 extern int get_analysis1_ptrs (const char *id, struct spak_analysis *A);
@@ -125,7 +143,34 @@ struct task_set {
 
   time_value Cql, Cqs, Cclk, Tclk;
 
+#ifdef USE_DVS
+  const struct dvfs_profile *profile;
+#endif
+
   struct spak_analysis Analysis;
+
+  struct undo_log *undo; // non-NULL while an annealer logs its moves
+};
+
+/*
+ * the priorities, thresholds, frequency levels and cluster merge flags
+ * that the current annealing move has overwritten, each recorded the
+ * first time it changes; rejecting the move puts them back instead of
+ * discarding a copy of the task set
+ */
+struct undo_entry {
+  int what;   // task number, or -1-c for the merge flag of cluster c
+  int P, PT;  // old priority and threshold, or old merge flag in P
+#ifdef USE_DVS
+  freq_level f;
+  time_value C;
+#endif
+};
+
+struct undo_log {
+  int num_entries;
+  struct undo_entry *entries;
+  char *saved; // max_tasks task flags, then max_task_clusters cluster flags
 };
 
 extern int ANNEAL_MAX;
@@ -149,6 +194,129 @@ extern int internal_set_analysis (struct spak_analysis *A, const char *which);
 
 extern int is_thresh_lower_than_pri (struct task_set *ts);
 
+extern void start_undo_log (struct task_set *ts);
+
+extern void stop_undo_log (struct task_set *ts);
+
+extern void keep_changes (struct task_set *ts);
+
+extern void undo_changes (struct task_set *ts);
+
+extern void save_task_pri (struct task_set *ts, int t);
+
+extern void save_cluster_merge (struct task_set *ts, int c);
+
+#ifdef USE_DVS
+extern void save_task_freq (struct task_set *ts, int t);
+#endif
+
+/*
+ * What a local search minimizes.  start() sets up a search's private
+ * state and returns the cost of its starting assignment, which it may
+ * adjust first.  cost() evaluates the move recorded in ts's undo log;
+ * it returns HUGE_VAL to reject the move outright, and may return
+ * HUGE_VAL as soon as it can tell the cost is above bound, since no
+ * move that bad will be taken.  settle() hears whether the move was
+ * kept.  A worse move that annealing takes by chance may cost at most
+ * slack(state, current cost).  Lower costs are better.
+ */
+struct search_objective {
+  void *(*start) (struct task_set *ts, void *arg, double *cost);
+  double (*cost) (struct task_set *ts, void *state, double bound);
+  void (*settle) (void *state, int accepted);   // may be NULL
+  void (*finish) (void *state, void *arg);      // may be NULL
+  double (*slack) (void *state, double cost);   // may be NULL
+  double goal;   // stop as soon as the cost gets this low
+  void *arg;
+};
+
+/*
+ * Where a local search can go from an assignment.  move() makes a
+ * random change; the strategies that look at every neighbour instead
+ * apply nth() for each k below size().  Both record what they change
+ * in ts's undo log.  nth() may leave ts unchanged when its move
+ * doesn't apply.
+ */
+struct search_neighbourhood {
+  void (*move) (struct task_set *ts, void *arg);
+  int (*size) (struct task_set *ts, void *arg);           // may be NULL
+  void (*nth) (struct task_set *ts, int k, void *arg);    // may be NULL
+  void *arg;
+};
+
+struct search {
+  const struct search_objective *obj;
+  const struct search_neighbourhood *moves;
+  enum search_strategy strategy;
+  int patience;   // steps without a new best before giving up
+};
+
+extern double local_search (struct task_set *ts, const struct search *s);
+
+extern double local_search_unfinished (struct task_set *ts,
+				       const struct search *s,
+				       void **state);
+
+extern double search_with_replicas (struct task_set **ts,
+				    const struct search *s);
+
+extern struct task_set *anneal_tempering (struct task_set *ts,
+					  const struct search *s,
+					  double *best_cost);
+
+/*
+ * the changes the annealers have always made, in each of the modes
+ * they run in, as a neighbourhood
+ */
+struct assignment_moves {
+  int PT;                  // thresholds may vary...
+  int target_pt_support;   // ...freely, or only between clusters
+  int preemptible;         // without PT: all preemptible or none
+};
+
+extern void init_assignment_neighbourhood (struct search_neighbourhood *nb,
+					   struct assignment_moves *m);
+
+#ifdef USE_DVS
+// one task's frequency one level up or down
+extern const struct search_neighbourhood freq_step_moves;
+#endif
+
+/*
+ * the tasks in order of non-increasing threshold (ties by task number),
+ * which thread_partition_moved keeps up to date when a single threshold
+ * changes, and the threshold each thread opened at
+ */
+struct thread_partition {
+  int n;
+  int *order;     // order[k] is the k-th task
+  int *pos;       // task t is at order[pos[t]]
+  int *ceiling;
+};
+
+extern void init_thread_partition (struct thread_partition *tp,
+				   struct task_set *ts);
+
+extern void sort_thread_partition (struct thread_partition *tp,
+				   struct task_set *ts);
+
+extern void free_thread_partition (struct thread_partition *tp);
+
+extern void thread_partition_moved (struct thread_partition *tp,
+				    struct task_set *ts,
+				    int t);
+
+extern int partition_into_threads (struct thread_partition *tp,
+				   struct task_set *ts);
+
+extern void init_anneal_streams (struct spak_rng *rngs, int n);
+
+extern void run_on_threads (int n,
+			    void *(*fn) (void *),
+			    void *args,
+			    size_t size,
+			    struct spak_rng *rngs);
+
 extern void permute_pri_and_thresh (struct task_set *ts);
 
 extern void permute_pri (struct task_set *ts);
@@ -177,4 +345,10 @@ extern int is_pri_unique (struct task_set *ts);
 
 extern int has_jitter (struct task_set *ts);
 
+extern int has_aet (struct task_set *ts);
+
+#ifdef USE_DVS
+extern void fill_task_level_wcets (struct task_set *ts, int t);
+#endif
+
 #endif